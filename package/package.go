@@ -40,8 +40,15 @@ func GetPackage() *denv.Package {
 	maintest.AddDependency(testlib)
 	maintest.AddDependencies(cunittestpkg.GetMainLib())
 
+	// benchmark application (source/bench), standard allocator workloads and replay of allocation traces
+	benchapp := denv.SetupCppAppProject(mainpkg, name+"_bench")
+	benchapp.AddDependency(mainlib)
+	benchapp.AddDependencies(ccorepkg.GetMainLib())
+	benchapp.AddDependencies(callocpkg.GetMainLib())
+
 	mainpkg.AddMainLib(mainlib)
 	mainpkg.AddTestLib(testlib)
 	mainpkg.AddUnittest(maintest)
+	mainpkg.AddMainApp(benchapp)
 	return mainpkg
 }
@@ -0,0 +1,191 @@
+#include "ccore/c_target.h"
+#include "ccore/c_allocator.h"
+
+#include "csuperalloc/c_superalloc.h"
+#include "csuperalloc/c_superalloc_config.h"
+#include "csuperalloc/c_superalloc_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace ncore;
+
+extern int gRunBenchSuite(alloc_t* heap, const char* filter, s16 num_threads, u32 scale, u32 num_nodes);
+
+// The heap for the book-keeping of the allocators and the benchmark itself
+class system_heap_t : public alloc_t
+{
+protected:
+    virtual void* v_allocate(u32 size, u32 alignment)
+    {
+        void* ptr = nullptr;
+#if defined(_MSC_VER)
+        ptr = _aligned_malloc(size, alignment);
+#else
+        if (posix_memalign(&ptr, alignment < sizeof(void*) ? sizeof(void*) : alignment, size) != 0)
+            ptr = nullptr;
+#endif
+        return ptr;
+    }
+
+    virtual void v_deallocate(void* ptr)
+    {
+#if defined(_MSC_VER)
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+
+    virtual void v_release() {}
+};
+
+// Reads a whole trace file, returns the records and the number of record pairs
+static s32* s_load_trace(alloc_t* heap, const char* filepath, u32& num_records)
+{
+    num_records = 0;
+    FILE* file  = fopen(filepath, "rb");
+    if (file == nullptr)
+        return nullptr;
+    fseek(file, 0, SEEK_END);
+    long const size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size <= 0 || (size % (2 * sizeof(s32))) != 0)
+    {
+        fclose(file);
+        return nullptr;
+    }
+
+    s32* records = (s32*)heap->allocate((u32)size);
+    if (records != nullptr && fread(records, 1, (size_t)size, file) == (size_t)size)
+        num_records = (u32)(size / (2 * sizeof(s32)));
+    fclose(file);
+    return records;
+}
+
+// The config to run with, '25p' and '10p' are the fixed configs, a number is the waste percentage of a computed config
+static nsuperalloc::config_t const* s_get_config(alloc_t* heap, const char* name, bool& computed)
+{
+    computed = false;
+    if (strcmp(name, "25p") == 0)
+        return nsuperalloc::gConfigWindowsDesktopApp25p();
+    if (strcmp(name, "10p") == 0)
+        return nsuperalloc::gConfigWindowsDesktopApp10p();
+
+    nsuperalloc::configgen_t params;
+    params.m_waste_percentage = (u32)atoi(name);
+    computed                  = true;
+    return nsuperalloc::gConfigCompute(heap, params);
+}
+
+static void s_print_usage()
+{
+    printf("usage: csuperalloc_bench replay <trace file> [config] [threads]\n");
+    printf("    config    25p (default), 10p or a waste percentage for a computed config\n");
+    printf("    threads   number of thread allocators (sharing one address space, 25p only) the trace threads map to\n");
+    printf("usage: csuperalloc_bench suite [benchmark] [threads] [scale] [nodes]\n");
+    printf("    benchmark all (default), larson, xmalloc-test, cache-scratch, cache-thrash, mstress, alloc-test, churn,\n");
+    printf("              free-path, tagless or tlb-walk\n");
+    printf("    threads   number of threads (default 4)\n");
+    printf("    scale     multiplier of the number of iterations (default 1)\n");
+    printf("    nodes     number of simulated NUMA nodes superalloc spreads the threads over (default 1)\n");
+}
+
+// Replays a trace and prints the result as a single JSON object
+static int s_replay(alloc_t* heap, const char* filepath, const char* config_name, s16 num_threads)
+{
+    u32  num_records = 0;
+    s32* records     = s_load_trace(heap, filepath, num_records);
+    if (records == nullptr || num_records == 0)
+    {
+        printf("error: unable to load trace '%s'\n", filepath);
+        return 1;
+    }
+
+    // The threaded context always runs with the fixed 25p config
+    if (num_threads > 1 && strcmp(config_name, "25p") != 0)
+    {
+        printf("error: a threaded replay only supports the 25p config\n");
+        heap->deallocate(records);
+        return 1;
+    }
+
+    bool                               computed = false;
+    nsuperalloc::config_t const* const config   = s_get_config(heap, config_name, computed);
+    if (config == nullptr)
+    {
+        printf("error: invalid config '%s'\n", config_name);
+        heap->deallocate(records);
+        return 1;
+    }
+
+    nsuperalloc::replay_stats_t stats;
+    bool                        valid = false;
+    if (num_threads <= 1)
+    {
+        nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(heap, config);
+        valid                          = nsuperalloc::gReplayTrace(heap, &valloc, 1, records, num_records, stats);
+        gDestroyVmAllocator(valloc);
+    }
+    else
+    {
+        vm_allocator_threaded_context_t* ctxt       = gCreateVmAllocatorThreadedContext(heap, num_threads);
+        vm_allocator_threaded_t**        threads    = g_allocate_array<vm_allocator_threaded_t*>(heap, num_threads);
+        nsuperalloc::vmalloc_t**         allocators = g_allocate_array<nsuperalloc::vmalloc_t*>(heap, num_threads);
+        for (s16 i = 0; i < num_threads; ++i)
+        {
+            threads[i]    = gCreateVmAllocatorForThread(ctxt, i);
+            allocators[i] = gGetVmAllocatorOfThread(threads[i]);
+        }
+        valid = nsuperalloc::gReplayTrace(heap, allocators, (u32)num_threads, records, num_records, stats);
+        for (s16 i = 0; i < num_threads; ++i)
+            gFinalizeVmAllocatorForThread(ctxt, threads[i]);
+        g_deallocate_array(heap, allocators);
+        g_deallocate_array(heap, threads);
+        gDestroyVmAllocatorThreadedContext(ctxt);
+    }
+
+    printf("{\"trace\":\"%s\",\"config\":\"%s\",\"threads\":%d,\"valid\":%s,", filepath, config_name, (int)num_threads, valid ? "true" : "false");
+    printf("\"alloc\":{\"ops\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu},", (unsigned long long)stats.m_ops[nsuperalloc::replay_stats_t::cAlloc], (unsigned long long)stats.m_p50_ns[nsuperalloc::replay_stats_t::cAlloc],
+           (unsigned long long)stats.m_p99_ns[nsuperalloc::replay_stats_t::cAlloc], (unsigned long long)stats.m_p999_ns[nsuperalloc::replay_stats_t::cAlloc]);
+    printf("\"free\":{\"ops\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu},", (unsigned long long)stats.m_ops[nsuperalloc::replay_stats_t::cFree], (unsigned long long)stats.m_p50_ns[nsuperalloc::replay_stats_t::cFree],
+           (unsigned long long)stats.m_p99_ns[nsuperalloc::replay_stats_t::cFree], (unsigned long long)stats.m_p999_ns[nsuperalloc::replay_stats_t::cFree]);
+    printf("\"ops_per_sec\":%llu,\"failed_allocs\":%u,\"page_size\":%u,", (unsigned long long)stats.m_ops_per_sec, stats.m_failed_allocs, stats.m_page_size);
+    printf("\"peak_committed_pages\":%u,\"peak_live_bytes\":%llu,\"peak_fragmentation\":%.4f,", stats.m_peak_committed_pages, (unsigned long long)stats.m_peak_live_bytes, stats.peak_fragmentation());
+    printf("\"final_committed_pages\":%u,\"final_live_bytes\":%llu,\"final_fragmentation\":%.4f}\n", stats.m_final_committed_pages, (unsigned long long)stats.m_final_live_bytes, stats.final_fragmentation());
+
+    if (computed)
+        nsuperalloc::gConfigDestroy(heap, config);
+    heap->deallocate(records);
+    return valid ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    system_heap_t heap;
+
+    if (argc >= 3 && strcmp(argv[1], "replay") == 0)
+    {
+        const char* config_name = argc >= 4 ? argv[3] : "25p";
+        s16 const   num_threads = argc >= 5 ? (s16)atoi(argv[4]) : 1;
+        return s_replay(&heap, argv[2], config_name, num_threads);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "suite") == 0)
+    {
+        const char* filter      = argc >= 3 ? argv[2] : "all";
+        s16 const   num_threads = argc >= 4 ? (s16)atoi(argv[3]) : 4;
+        u32 const   scale       = argc >= 5 ? (u32)atoi(argv[4]) : 1;
+        u32 const   num_nodes   = argc >= 6 ? (u32)atoi(argv[5]) : 1;
+        if (num_threads < 1 || scale < 1 || num_nodes < 1)
+        {
+            s_print_usage();
+            return 1;
+        }
+        return gRunBenchSuite(&heap, filter, num_threads, scale, num_nodes);
+    }
+
+    s_print_usage();
+    return 1;
+}
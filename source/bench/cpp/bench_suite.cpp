@@ -0,0 +1,741 @@
+#include "ccore/c_target.h"
+#include "ccore/c_allocator.h"
+
+#include "csuperalloc/c_lsa.h"
+#include "csuperalloc/c_superalloc.h"
+#include "csuperalloc/c_superalloc_config.h"
+#include "csuperalloc/private/c_platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+using namespace ncore;
+
+// --------------------------------------------------------------------------------------------
+// Standard allocator workloads (larson, xmalloc-test, cache-scratch/cache-thrash, mstress, alloc-test)
+// and a single size churn loop per bin, each run against superalloc and system malloc, followed by a few
+// superalloc only measurements. Every result is printed as a single line JSON object.
+
+namespace nbench
+{
+    // Random numbers, one generator per thread
+    struct rnd_t
+    {
+        u64 m_state;
+
+        rnd_t(u64 seed)
+            : m_state((seed * 0x9E3779B97F4A7C15ull) | 1)
+        {
+        }
+
+        inline u32 next()
+        {
+            m_state ^= m_state << 13;
+            m_state ^= m_state >> 7;
+            m_state ^= m_state << 17;
+            return (u32)(m_state >> 32);
+        }
+
+        inline u32 range(u32 min, u32 max) { return min + (next() % (max - min + 1)); }
+    };
+
+    // The allocator under test, every thread allocates through its own alloc_t
+    class target_t
+    {
+    public:
+        virtual const char* name() const                   = 0;
+        virtual void        begin(s16 num_threads)         = 0;  // Before a workload, the main thread uses index 'num_threads'
+        virtual alloc_t*    thread_begin(s16 thread_index) = 0;  // Returns the allocator of the thread (the same one while it is live)
+        virtual void        thread_end(s16 thread_index)   = 0;
+        virtual u64         committed_bytes()              = 0;  // 0 when unknown
+        virtual void        end()                          = 0;
+    };
+
+    class malloc_alloc_t : public alloc_t
+    {
+    protected:
+        virtual void* v_allocate(u32 size, u32) { return malloc(size); }
+        virtual void  v_deallocate(void* ptr) { free(ptr); }
+        virtual void  v_release() {}
+    };
+
+    class system_target_t : public target_t
+    {
+    public:
+        virtual const char* name() const { return "system"; }
+        virtual void        begin(s16) {}
+        virtual alloc_t*    thread_begin(s16) { return &m_malloc; }
+        virtual void        thread_end(s16) {}
+        virtual u64         committed_bytes() { return 0; }
+        virtual void        end() {}
+
+        malloc_alloc_t m_malloc;
+    };
+
+    // The NUMA node of a benchmark thread when the topology is faked, threads are spread over the nodes
+    static thread_local u32 s_thread_node = 0;
+
+    static u32 s_fake_node(void*) { return s_thread_node; }
+
+    // All threads share one superspace, the main thread uses the thread index after the workers.
+    // With more than one (fake) NUMA node the superspace runs in NUMA mode.
+    class superalloc_target_t : public target_t
+    {
+    public:
+        superalloc_target_t(alloc_t* heap, u32 num_nodes)
+            : m_heap(heap)
+            , m_ctxt(nullptr)
+            , m_threads(nullptr)
+            , m_num_threads(0)
+            , m_num_nodes(num_nodes)
+        {
+        }
+
+        virtual const char* name() const { return m_num_nodes > 1 ? "superalloc-numa" : "superalloc"; }
+
+        virtual void begin(s16 num_threads)
+        {
+            m_num_threads = num_threads + 1;
+            if (m_num_nodes > 1)
+            {
+                nsuperalloc::numa_t numa;
+                numa.m_num_nodes = m_num_nodes;
+                numa.m_padding   = 0;
+                numa.m_node_fn   = s_fake_node;
+                numa.m_node_user = nullptr;
+                m_ctxt           = gCreateVmAllocatorThreadedContext(m_heap, numa, m_num_threads);
+            }
+            else
+            {
+                m_ctxt = gCreateVmAllocatorThreadedContext(m_heap, m_num_threads);
+            }
+            m_threads     = g_allocate_array<vm_allocator_threaded_t*>(m_heap, m_num_threads);
+            for (s16 i = 0; i < m_num_threads; ++i)
+                m_threads[i] = nullptr;
+            thread_begin(num_threads);
+        }
+
+        virtual alloc_t* thread_begin(s16 thread_index)
+        {
+            s_thread_node           = (u32)thread_index % (m_num_nodes > 1 ? m_num_nodes : 1);
+            m_threads[thread_index] = gCreateVmAllocatorForThread(m_ctxt, thread_index);
+            return gGetVmAllocatorOfThread(m_threads[thread_index]);
+        }
+
+        virtual void thread_end(s16 thread_index)
+        {
+            gFinalizeVmAllocatorForThread(m_ctxt, m_threads[thread_index]);
+            m_threads[thread_index] = nullptr;
+        }
+
+        virtual u64 committed_bytes()
+        {
+            nsuperalloc::stats_t* stats = g_allocate<nsuperalloc::stats_t>(m_heap);
+            gGetVmAllocatorOfThread(m_threads[m_num_threads - 1])->get_stats(*stats);
+            u64 const bytes = (u64)stats->m_committed_pages * stats->m_page_size;
+            g_deallocate(m_heap, stats);
+            return bytes;
+        }
+
+        virtual void end()
+        {
+            thread_end(m_num_threads - 1);
+            g_deallocate_array(m_heap, m_threads);
+            gDestroyVmAllocatorThreadedContext(m_ctxt);
+            m_ctxt    = nullptr;
+            m_threads = nullptr;
+        }
+
+        alloc_t*                         m_heap;
+        vm_allocator_threaded_context_t* m_ctxt;
+        vm_allocator_threaded_t**        m_threads;
+        s16                              m_num_threads;
+        u32                              m_num_nodes;
+    };
+
+    static void s_report(const char* bench, target_t* target, s16 num_threads, u64 ops, u64 ns, u64 committed_bytes)
+    {
+        u64 const ops_per_sec = ns > 0 ? (u64)(((f64)ops * 1000000000.0) / (f64)ns) : 0;
+        printf("{\"bench\":\"%s\",\"allocator\":\"%s\",\"threads\":%d,\"ops\":%llu,\"ns\":%llu,\"ops_per_sec\":%llu,\"committed_bytes\":%llu}\n", bench, target->name(), (int)num_threads, (unsigned long long)ops, (unsigned long long)ns,
+               (unsigned long long)ops_per_sec, (unsigned long long)committed_bytes);
+        fflush(stdout);
+    }
+
+    // Runs 'fn(thread_index)' on 'num_threads' threads and waits for all of them
+    template <typename F>
+    static void s_run_threads(s16 num_threads, F fn)
+    {
+        std::thread* threads = new std::thread[num_threads];
+        for (s16 i = 0; i < num_threads; ++i)
+            threads[i] = std::thread(fn, i);
+        for (s16 i = 0; i < num_threads; ++i)
+            threads[i].join();
+        delete[] threads;
+    }
+
+    // --------------------------------------------------------------------------------------------
+    // larson: server simulation, every round new threads take over the objects of the previous round's
+    // threads and randomly replace them, so most objects are freed by another thread than the one that
+    // allocated them.
+    static void s_larson(target_t* target, s16 num_threads, u32 scale)
+    {
+        u32 const num_slots = 1000;
+        u32 const rounds    = 10;
+        u32 const steps     = 20000 * scale;
+
+        target->begin(num_threads);
+        void*** slots = new void**[num_threads];
+        for (s16 t = 0; t < num_threads; ++t)
+        {
+            slots[t] = new void*[num_slots];
+            memset(slots[t], 0, sizeof(void*) * num_slots);
+        }
+
+        std::atomic<u64> ops(0);
+        u64 const        begin = nplatform::time_ns();
+        for (u32 r = 0; r < rounds; ++r)
+        {
+            s_run_threads(num_threads, [&](s16 t) {
+                alloc_t* a     = target->thread_begin(t);
+                void**   s     = slots[(t + r) % num_threads];
+                rnd_t    rnd(((u64)r << 16) | (u64)t);
+                u64      count = 0;
+                for (u32 i = 0; i < steps; ++i)
+                {
+                    u32 const j = rnd.next() % num_slots;
+                    if (s[j] != nullptr)
+                    {
+                        a->deallocate(s[j]);
+                        count += 1;
+                    }
+                    s[j] = a->allocate(rnd.range(16, 1024));
+                    count += 1;
+                }
+                target->thread_end(t);
+                ops += count;
+            });
+        }
+        u64 const ns        = nplatform::time_ns() - begin;
+        u64 const committed = target->committed_bytes();
+
+        alloc_t* a = target->thread_begin(num_threads);
+        for (s16 t = 0; t < num_threads; ++t)
+        {
+            for (u32 j = 0; j < num_slots; ++j)
+            {
+                if (slots[t][j] != nullptr)
+                    a->deallocate(slots[t][j]);
+            }
+            delete[] slots[t];
+        }
+        delete[] slots;
+        target->end();
+        s_report("larson", target, num_threads, ops, ns, committed);
+    }
+
+    // --------------------------------------------------------------------------------------------
+    // xmalloc-test: producer/consumer, half of the threads allocate batches of objects and hand them to
+    // the other half which frees them.
+    struct batch_queue_t
+    {
+        enum
+        {
+            cBatchSize = 256,
+            cCapacity  = 1024,
+        };
+
+        struct batch_t
+        {
+            void* m_ptrs[cBatchSize];
+        };
+
+        std::mutex m_mutex;
+        batch_t*   m_batches[cCapacity];
+        u32        m_head;
+        u32        m_tail;
+
+        batch_queue_t()
+            : m_head(0)
+            , m_tail(0)
+        {
+        }
+
+        bool push(batch_t* batch)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if ((m_tail - m_head) == cCapacity)
+                return false;
+            m_batches[m_tail++ % cCapacity] = batch;
+            return true;
+        }
+
+        batch_t* pop()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_tail == m_head)
+                return nullptr;
+            return m_batches[m_head++ % cCapacity];
+        }
+    };
+
+    static void s_xmalloc(target_t* target, s16 num_threads, u32 scale)
+    {
+        s16 const num_producers = num_threads < 2 ? 1 : num_threads / 2;
+        s16 const num_consumers = num_threads < 2 ? 1 : num_threads - num_producers;
+        s16 const total_threads = num_producers + num_consumers;
+        u32 const batches       = 2000 * scale;
+
+        target->begin(total_threads);
+        batch_queue_t*   queue = new batch_queue_t();
+        std::atomic<s32> producing(num_producers);
+        std::atomic<u64> ops(0);
+
+        u64 const begin = nplatform::time_ns();
+        s_run_threads(total_threads, [&](s16 t) {
+            alloc_t* a     = target->thread_begin(t);
+            u64      count = 0;
+            if (t < num_producers)
+            {
+                rnd_t rnd((u64)t + 1);
+                for (u32 b = 0; b < batches; ++b)
+                {
+                    batch_queue_t::batch_t* batch = new batch_queue_t::batch_t();
+                    for (u32 i = 0; i < batch_queue_t::cBatchSize; ++i)
+                        batch->m_ptrs[i] = a->allocate(rnd.range(8, 256));
+                    count += batch_queue_t::cBatchSize;
+                    while (!queue->push(batch))
+                        std::this_thread::yield();
+                }
+                producing -= 1;
+            }
+            else
+            {
+                while (true)
+                {
+                    batch_queue_t::batch_t* batch = queue->pop();
+                    if (batch == nullptr)
+                    {
+                        if (producing.load() == 0 && (batch = queue->pop()) == nullptr)
+                            break;
+                        if (batch == nullptr)
+                        {
+                            std::this_thread::yield();
+                            continue;
+                        }
+                    }
+                    for (u32 i = 0; i < batch_queue_t::cBatchSize; ++i)
+                        a->deallocate(batch->m_ptrs[i]);
+                    count += batch_queue_t::cBatchSize;
+                    delete batch;
+                }
+            }
+            target->thread_end(t);
+            ops += count;
+        });
+        u64 const ns        = nplatform::time_ns() - begin;
+        u64 const committed = target->committed_bytes();
+
+        delete queue;
+        target->end();
+        s_report("xmalloc-test", target, total_threads, ops, ns, committed);
+    }
+
+    // --------------------------------------------------------------------------------------------
+    // cache-scratch / cache-thrash: threads repeatedly allocate a small object, write to it and free it.
+    // With 'scratch' every thread first frees an object that was allocated (next to the objects of the
+    // other threads) by the main thread, an allocator that hands that memory back to the thread causes
+    // passive false sharing. Without it (thrash) only the objects the threads allocate can share a line.
+    static void s_cache(target_t* target, s16 num_threads, u32 scale, bool scratch)
+    {
+        u32 const object_size = 8;
+        u32 const iterations  = 1000 * scale;
+        u32 const repetitions = 1000;
+
+        target->begin(num_threads);
+        alloc_t* main    = target->thread_begin(num_threads);
+        void**   objects = new void*[num_threads];
+        for (s16 t = 0; t < num_threads; ++t)
+            objects[t] = scratch ? main->allocate(object_size) : nullptr;
+
+        u64 const begin = nplatform::time_ns();
+        s_run_threads(num_threads, [&](s16 t) {
+            alloc_t* a = target->thread_begin(t);
+            if (objects[t] != nullptr)
+                a->deallocate(objects[t]);
+            for (u32 i = 0; i < iterations; ++i)
+            {
+                char volatile* obj = (char volatile*)a->allocate(object_size);
+                for (u32 r = 0; r < repetitions; ++r)
+                {
+                    for (u32 j = 0; j < object_size; ++j)
+                        obj[j] = (char)(obj[j] + 1);
+                }
+                a->deallocate((void*)obj);
+            }
+            target->thread_end(t);
+        });
+        u64 const ns        = nplatform::time_ns() - begin;
+        u64 const committed = target->committed_bytes();
+
+        delete[] objects;
+        target->end();
+        s_report(scratch ? "cache-scratch" : "cache-thrash", target, num_threads, (u64)num_threads * iterations * 2, ns, committed);
+    }
+
+    // --------------------------------------------------------------------------------------------
+    // mstress: threads keep a working set of mostly small objects with the occasional large one, a part
+    // of the objects is exchanged through a shared array and freed by whichever thread takes it out.
+    static void s_mstress(target_t* target, s16 num_threads, u32 scale)
+    {
+        u32 const num_local    = 500;
+        u32 const num_transfer = 1000;
+        u32 const steps        = 100000 * scale;
+
+        target->begin(num_threads);
+        std::atomic<void*>* transfer = new std::atomic<void*>[num_transfer];
+        for (u32 i = 0; i < num_transfer; ++i)
+            transfer[i].store(nullptr);
+        std::atomic<u64> ops(0);
+
+        u64 const begin = nplatform::time_ns();
+        s_run_threads(num_threads, [&](s16 t) {
+            alloc_t* a     = target->thread_begin(t);
+            void**   local = new void*[num_local];
+            memset(local, 0, sizeof(void*) * num_local);
+            rnd_t rnd((u64)t + 7);
+            u64   count = 0;
+            for (u32 i = 0; i < steps; ++i)
+            {
+                u32 const r    = rnd.next();
+                u32 const size = ((r & 63) == 0) ? rnd.range(1024, 32 * 1024) : rnd.range(8, 256);
+                void*     ptr  = a->allocate(size);
+                count += 1;
+                if ((r & 0x700) == 0)
+                {
+                    // Hand it over, free what was there
+                    ptr = transfer[(r >> 16) % num_transfer].exchange(ptr);
+                }
+                else
+                {
+                    u32 const j = (r >> 16) % num_local;
+                    void*     p = local[j];
+                    local[j]    = ptr;
+                    ptr         = p;
+                }
+                if (ptr != nullptr)
+                {
+                    a->deallocate(ptr);
+                    count += 1;
+                }
+            }
+            for (u32 j = 0; j < num_local; ++j)
+            {
+                if (local[j] != nullptr)
+                {
+                    a->deallocate(local[j]);
+                    count += 1;
+                }
+            }
+            delete[] local;
+            target->thread_end(t);
+            ops += count;
+        });
+        u64 const ns        = nplatform::time_ns() - begin;
+        u64 const committed = target->committed_bytes();
+
+        alloc_t* a = target->thread_begin(num_threads);
+        for (u32 i = 0; i < num_transfer; ++i)
+        {
+            void* ptr = transfer[i].load();
+            if (ptr != nullptr)
+                a->deallocate(ptr);
+        }
+        delete[] transfer;
+        target->end();
+        s_report("mstress", target, num_threads, ops, ns, committed);
+    }
+
+    // --------------------------------------------------------------------------------------------
+    // alloc-test: every thread replaces the oldest object of a fixed size working set (a ring) with a new
+    // object of a random size, smaller sizes are more likely.
+    static void s_alloc_test(target_t* target, s16 num_threads, u32 scale)
+    {
+        u32 const ring  = 1 << 14;
+        u32 const steps = 1000000 * scale;
+
+        target->begin(num_threads);
+        std::atomic<u64> ops(0);
+
+        u64 const begin = nplatform::time_ns();
+        s_run_threads(num_threads, [&](s16 t) {
+            alloc_t* a     = target->thread_begin(t);
+            void**   slots = new void*[ring];
+            memset(slots, 0, sizeof(void*) * ring);
+            rnd_t rnd((u64)t + 13);
+            u64   count = 0;
+            for (u32 i = 0; i < steps; ++i)
+            {
+                u32 const j = i & (ring - 1);
+                if (slots[j] != nullptr)
+                {
+                    a->deallocate(slots[j]);
+                    count += 1;
+                }
+                u32 const shift = rnd.next() % 10;
+                slots[j]        = a->allocate(rnd.range(8, 16 << shift));
+                count += 1;
+            }
+            for (u32 j = 0; j < ring; ++j)
+            {
+                if (slots[j] != nullptr)
+                    a->deallocate(slots[j]);
+            }
+            delete[] slots;
+            target->thread_end(t);
+            ops += count;
+        });
+        u64 const ns        = nplatform::time_ns() - begin;
+        u64 const committed = target->committed_bytes();
+
+        target->end();
+        s_report("alloc-test", target, num_threads, ops, ns, committed);
+    }
+
+    // --------------------------------------------------------------------------------------------
+    // churn: single thread, for every bin size of the default config allocate a batch of objects and
+    // free them again.
+    static void s_churn(target_t* target, u32 scale)
+    {
+        nsuperalloc::config_t const* config = nsuperalloc::gConfigWindowsDesktopApp25p();
+
+        target->begin(1);
+        alloc_t* a     = target->thread_begin(0);
+        void**   batch = new void*[64];
+
+        u32 prev_size = 0;
+        for (s16 b = 0; b < config->m_alignedbin_index; ++b)
+        {
+            u32 const size = config->m_abinconfigs[b].m_alloc_size;
+            if (size <= prev_size || size > (1 * cMB))
+                continue;
+            prev_size = size;
+
+            u32 const count      = (16 * cMB) / size < 64 ? (u32)((16 * cMB) / size) : 64;
+            u32 const iterations = 2000 * scale;
+            u64 const begin      = nplatform::time_ns();
+            for (u32 i = 0; i < iterations; ++i)
+            {
+                for (u32 j = 0; j < count; ++j)
+                    batch[j] = a->allocate(size);
+                for (u32 j = 0; j < count; ++j)
+                    a->deallocate(batch[j]);
+            }
+            u64 const ns  = nplatform::time_ns() - begin;
+            u64 const ops = (u64)iterations * count * 2;
+            printf("{\"bench\":\"churn\",\"allocator\":\"%s\",\"threads\":1,\"size\":%u,\"ops\":%llu,\"ns\":%llu,\"ns_per_op\":%.2f}\n", target->name(), size, (unsigned long long)ops, (unsigned long long)ns, (f64)ns / (f64)ops);
+            fflush(stdout);
+        }
+
+        delete[] batch;
+        target->thread_end(0);
+        target->end();
+    }
+
+    // --------------------------------------------------------------------------------------------
+    // free-path: single thread, for every bin size of the default config time only the deallocation of a
+    // batch of objects, and the element index computation of the free path (reciprocal multiply) against
+    // a plain divide over all element offsets of a chunk.
+    static void s_free_path(alloc_t* heap, u32 scale)
+    {
+        nsuperalloc::config_t const* config = nsuperalloc::gConfigWindowsDesktopApp25p();
+        nsuperalloc::vmalloc_t*      valloc = gCreateVmAllocator(heap, config);
+        void**                       batch  = new void*[64];
+
+        u32 prev_size = 0;
+        for (s16 b = 0; b < config->m_alignedbin_index; ++b)
+        {
+            nsuperalloc::binconfig_t const& bin  = config->m_abinconfigs[b];
+            u32 const                       size = bin.m_alloc_size;
+            if (size <= prev_size || size > (1 * cMB))
+                continue;
+            prev_size = size;
+
+            u32 const count      = (16 * cMB) / size < 64 ? (u32)((16 * cMB) / size) : 64;
+            u32 const iterations = 2000 * scale;
+            u64       free_ns    = 0;
+            for (u32 i = 0; i < iterations; ++i)
+            {
+                for (u32 j = 0; j < count; ++j)
+                    batch[j] = valloc->allocate(size);
+                u64 const begin = nplatform::time_ns();
+                for (u32 j = 0; j < count; ++j)
+                    valloc->deallocate(batch[j]);
+                free_ns += nplatform::time_ns() - begin;
+            }
+            u64 const frees = (u64)iterations * count;
+
+            u32 volatile divisor = size;  // Keep the compiler from turning the divide into a multiply
+            u32 const    rounds  = 16 * scale;
+
+            u64 const div_begin = nplatform::time_ns();
+            u64       div_sum   = 0;
+            for (u32 r = 0; r < rounds; ++r)
+                for (u32 e = 0; e < bin.m_max_alloc_count; ++e)
+                    div_sum += (u64)e * size / divisor;
+            u64 const div_ns = nplatform::time_ns() - div_begin;
+
+            u64 const mul_begin = nplatform::time_ns();
+            u64       mul_sum   = 0;
+            for (u32 r = 0; r < rounds; ++r)
+                for (u32 e = 0; e < bin.m_max_alloc_count; ++e)
+                    mul_sum += bin.offset_to_index((u64)e * size);
+            u64 const mul_ns = nplatform::time_ns() - mul_begin;
+
+            printf("{\"bench\":\"free-path\",\"allocator\":\"superalloc\",\"size\":%u,\"frees\":%llu,\"free_ns\":%llu,\"ns_per_free\":%.2f,\"index_ops\":%llu,\"div_ns\":%llu,\"mul_ns\":%llu,\"valid\":%s}\n", size, (unsigned long long)frees,
+                   (unsigned long long)free_ns, (f64)free_ns / (f64)frees, (unsigned long long)rounds * bin.m_max_alloc_count, (unsigned long long)div_ns, (unsigned long long)mul_ns, div_sum == mul_sum ? "true" : "false");
+            fflush(stdout);
+        }
+
+        delete[] batch;
+        gDestroyVmAllocator(valloc);
+    }
+
+    // --------------------------------------------------------------------------------------------
+    // tagless: single thread, fill chunks of the 16 byte bin of a tagged and a tagless allocator, timing
+    // only the first allocation of every chunk (the chunk checkout), then free everything again.
+    static void s_tagless(alloc_t* heap, u32 scale)
+    {
+        u32 const chunks   = 64 * scale;
+        u32 const elements = 64 * cKB / 16;  // Elements of the 16 byte bin in a 64 KiB chunk
+        void**    ptrs     = new void*[chunks * elements];
+
+        for (u32 t = 0; t < 2; ++t)
+        {
+            bool const              tagless = t == 1;
+            nsuperalloc::vmalloc_t* valloc  = gCreateVmAllocator(heap, tagless);
+
+            u64 checkout_ns = 0;
+            u64 rest_ns     = 0;
+            for (u32 c = 0; c < chunks; ++c)
+            {
+                u64 const checkout_begin = nplatform::time_ns();
+                ptrs[c * elements]       = valloc->allocate(16);
+                u64 const rest_begin     = nplatform::time_ns();
+                for (u32 e = 1; e < elements; ++e)
+                    ptrs[(c * elements) + e] = valloc->allocate(16);
+                u64 const rest_end = nplatform::time_ns();
+                checkout_ns += rest_begin - checkout_begin;
+                rest_ns += rest_end - rest_begin;
+            }
+
+            nsuperalloc::stats_t* stats = g_allocate<nsuperalloc::stats_t>(heap);
+            valloc->get_stats(*stats);
+            printf("{\"bench\":\"tagless\",\"allocator\":\"%s\",\"chunks\":%u,\"checkout_ns\":%llu,\"ns_per_checkout\":%.2f,\"ns_per_alloc\":%.2f,\"fsa_bytes\":%llu,\"committed_bytes\":%llu}\n",
+                   tagless ? "superalloc-tagless" : "superalloc", chunks, (unsigned long long)checkout_ns, (f64)checkout_ns / (f64)chunks, (f64)rest_ns / (f64)((u64)chunks * (elements - 1)), (unsigned long long)stats->m_internal_fsa_size,
+                   (unsigned long long)stats->m_committed_pages * stats->m_page_size);
+            fflush(stdout);
+            g_deallocate(heap, stats);
+
+            for (u32 i = 0; i < chunks * elements; ++i)
+                valloc->deallocate(ptrs[i]);
+            gDestroyVmAllocator(valloc);
+        }
+
+        delete[] ptrs;
+    }
+
+    // --------------------------------------------------------------------------------------------
+    // tlb-walk: a 32 MiB block from superalloc (backed by huge pages when the OS supports them) and the
+    // same block from an lsa (regular pages), both walked with a page stride in a pseudo-random order.
+    static u64 s_page_walk(u8* block, u64 size, u32 accesses)
+    {
+        u64 const num_pages = size >> 12;
+        u64       page      = 0;
+        u64       sum       = 0;
+        for (u32 i = 0; i < accesses; ++i)
+        {
+            page = (page * 6364136223846793005ull + 1442695040888963407ull) % num_pages;
+            block[(page << 12) + (i & 0xff)] += 1;
+            sum += block[page << 12];
+        }
+        return sum;
+    }
+
+    static void s_tlb_walk(alloc_t* heap, u32 scale)
+    {
+        u64 const block_size = 32 * cMB;
+        u32 const accesses   = 4 * 1024 * 1024 * scale;
+
+        nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(heap);
+        u8*                     huge   = (u8*)valloc->allocate((u32)block_size, 2 * cMB);
+        lsa_t*                  lsa    = nlsa::new_lsa((u32)block_size, 2);
+        u8*                     small  = (u8*)nlsa::allocate(lsa, (u32)block_size);
+
+        for (u64 i = 0; i < block_size; i += 4096)
+        {
+            huge[i]  = 0;
+            small[i] = 0;
+        }
+
+        u64 const huge_begin = nplatform::time_ns();
+        u64 const huge_sum   = s_page_walk(huge, block_size, accesses);
+        u64 const huge_ns    = nplatform::time_ns() - huge_begin;
+
+        u64 const small_begin = nplatform::time_ns();
+        u64 const small_sum   = s_page_walk(small, block_size, accesses);
+        u64 const small_ns    = nplatform::time_ns() - small_begin;
+
+        printf("{\"bench\":\"tlb-walk\",\"block_size\":%llu,\"accesses\":%u,\"hugepage_shift\":%d,\"huge_ns\":%llu,\"small_ns\":%llu,\"valid\":%s}\n", (unsigned long long)block_size, accesses, (int)nplatform::hugepage_size_shift(),
+               (unsigned long long)huge_ns, (unsigned long long)small_ns, huge_sum == small_sum ? "true" : "false");
+        fflush(stdout);
+
+        nlsa::deallocate(lsa, small);
+        nlsa::destroy(lsa);
+        valloc->deallocate(huge);
+        gDestroyVmAllocator(valloc);
+    }
+
+    static bool s_selected(const char* filter, const char* bench) { return filter == nullptr || strcmp(filter, "all") == 0 || strcmp(filter, bench) == 0; }
+
+}  // namespace nbench
+
+// Runs the workloads (all or the one named by 'filter') against superalloc and system malloc, then the
+// superalloc only measurements
+int gRunBenchSuite(alloc_t* heap, const char* filter, s16 num_threads, u32 scale, u32 num_nodes)
+{
+    nbench::superalloc_target_t superalloc(heap, num_nodes);
+    nbench::system_target_t     system;
+    nbench::target_t*           targets[] = {&superalloc, &system};
+
+    for (u32 i = 0; i < 2; ++i)
+    {
+        nbench::target_t* target = targets[i];
+        if (nbench::s_selected(filter, "larson"))
+            nbench::s_larson(target, num_threads, scale);
+        if (nbench::s_selected(filter, "xmalloc-test"))
+            nbench::s_xmalloc(target, num_threads, scale);
+        if (nbench::s_selected(filter, "cache-scratch"))
+            nbench::s_cache(target, num_threads, scale, true);
+        if (nbench::s_selected(filter, "cache-thrash"))
+            nbench::s_cache(target, num_threads, scale, false);
+        if (nbench::s_selected(filter, "mstress"))
+            nbench::s_mstress(target, num_threads, scale);
+        if (nbench::s_selected(filter, "alloc-test"))
+            nbench::s_alloc_test(target, num_threads, scale);
+        if (nbench::s_selected(filter, "churn"))
+            nbench::s_churn(target, scale);
+    }
+
+    if (nbench::s_selected(filter, "free-path"))
+        nbench::s_free_path(heap, scale);
+    if (nbench::s_selected(filter, "tagless"))
+        nbench::s_tagless(heap, scale);
+    if (nbench::s_selected(filter, "tlb-walk"))
+        nbench::s_tlb_walk(heap, scale);
+    return 0;
+}
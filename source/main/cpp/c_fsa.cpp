@@ -387,6 +387,12 @@ namespace ncore
             return ((u32)1 << block->m_alloc_size_shift);
         }
 
+        u64 get_used_size(fsa_t* fsa)
+        {
+            // Blocks are fully committed while they are in use
+            return (u64)fsa->m_block_count << fsa->m_block_size_shift;
+        }
+
         // The maximum address range of the fsa is 4 GB, and since the smallest
         // allocation size is 8 bytes, we can shift right 3 bits and fit in u32.
         void* idx2ptr(fsa_t* fsa, u32 i)
@@ -135,6 +135,32 @@ namespace ncore
                 block->m_pages = num_pages;
             }
 
+            // commit or decommit the tail pages of an active block so that it can hold 'alloc_size' bytes,
+            // returns false (block untouched) when the tail pages could not be committed
+            bool resize(lsa_t* lsa, block_t* block, u32 alloc_size)
+            {
+                byte*     block_address = block_index_to_address(lsa, block_to_index(lsa, block));
+                const u32 num_pages     = ((u64)alloc_size + (((u64)1 << lsa->m_page_size_shift) - 1)) >> lsa->m_page_size_shift;
+                if (num_pages > block->m_pages)
+                {
+                    byte*       tail_address = block_address + ((u64)block->m_pages << lsa->m_page_size_shift);
+                    const int_t commit_size  = (int_t)((u64)(num_pages - block->m_pages) << lsa->m_page_size_shift);
+                    if (!v_alloc_commit(tail_address, commit_size))
+                        return false;
+#ifdef LSA_DEBUG
+                    nmem::memset(tail_address, 0xCDCDCDCD, commit_size);
+#endif
+                }
+                else if (num_pages < block->m_pages)
+                {
+                    byte*       tail_address  = block_address + ((u64)num_pages << lsa->m_page_size_shift);
+                    const int_t decommit_size = (int_t)((u64)(block->m_pages - num_pages) << lsa->m_page_size_shift);
+                    v_alloc_decommit(tail_address, decommit_size);
+                }
+                block->m_pages = num_pages;
+                return true;
+            }
+
             void deactivate(lsa_t* lsa, block_t* block)
             {
                 if (block->m_pages > 0)
@@ -254,6 +280,29 @@ namespace ncore
             nblock::deallocate_block(lsa, block);
         }
 
+        void* reallocate(lsa_t* lsa, void* ptr, u32 new_size)
+        {
+            if (ptr == nullptr)
+                return allocate(lsa, new_size);
+            if (new_size == 0)
+            {
+                deallocate(lsa, ptr);
+                return nullptr;
+            }
+
+            // A block can be resized in place up to the block size, beyond that the caller has to move the
+            // allocation to an lsa with a larger block size.
+            if (new_size > ((u32)1 << lsa->m_block_size_shift))
+                return nullptr;
+
+            ASSERT(is_managed_by(lsa, ptr));
+            u16 const block_index = nblock::block_index_from_ptr(lsa, (byte const*)ptr);
+            block_t*  block       = nblock::block_from_index(lsa, block_index);
+            if (!nblock::resize(lsa, block, new_size))
+                return nullptr;
+            return ptr;
+        }
+
         u32 get_size(lsa_t* lsa, void* ptr)
         {
             if (ptr == nullptr)
@@ -1,19 +1,24 @@
+#include "ccore/c_target.h"
+#include "ccore/c_debug.h"
 
+#include "csuperalloc/private/c_multithread.h"
 
+namespace ncore
+{
+    void spinlock_t::lock()
+    {
+        while (natomic::exchange_s32(&m_lock, 1) != 0)
+        {
+            // Spin on a plain load so that we do not keep bouncing the cache line between cores
+            while (natomic::load_s32(&m_lock) != 0)
+                natomic::pause();
+        }
+    }
 
-// static inline void heap_lock_acquire(void)
-// {
-// 	uintptr_t lock = 0;
-// 	uintptr_t this_lock = get_thread_id();
-// 	while (!atomic_compare_exchange_strong(&global_heap_lock, &lock, this_lock))
-//     {
-// 		lock = 0;
-// 		wait_spin();
-// 	}
-// }
+    void spinlock_t::unlock()
+    {
+        ASSERT(natomic::load_s32(&m_lock) == 1);  // Unlocking a lock that is not locked
+        natomic::store_s32(&m_lock, 0);
+    }
 
-// static inline void heap_lock_release(void)
-// {
-// 	assert((uintptr_t)atomic_load_explicit(&global_heap_lock, memory_order_relaxed) == get_thread_id(), "Bad heap lock");
-// 	atomic_store_explicit(&global_heap_lock, 0, memory_order_release);
-// }
+}  // namespace ncore
@@ -0,0 +1,294 @@
+#include "ccore/c_target.h"
+#include "ccore/c_debug.h"
+
+#include "csuperalloc/private/c_platform.h"
+
+#if defined(CC_PLATFORM_WINDOWS)
+#    define WIN32_LEAN_AND_MEAN
+#    include <windows.h>
+#else
+#    include <time.h>
+#    include <fcntl.h>
+#    include <unistd.h>
+#    include <sys/mman.h>
+#    if defined(__linux__)
+#        include <sys/syscall.h>
+#    endif
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace ncore
+{
+    namespace nplatform
+    {
+#if defined(CC_PLATFORM_WINDOWS)
+        u64 time_ms() { return (u64)GetTickCount64(); }
+
+        u64 time_us()
+        {
+            LARGE_INTEGER frequency, counter;
+            QueryPerformanceFrequency(&frequency);
+            QueryPerformanceCounter(&counter);
+            return (u64)((counter.QuadPart / frequency.QuadPart) * 1000000 + ((counter.QuadPart % frequency.QuadPart) * 1000000) / frequency.QuadPart);
+        }
+
+        u64 time_ns()
+        {
+            LARGE_INTEGER frequency, counter;
+            QueryPerformanceFrequency(&frequency);
+            QueryPerformanceCounter(&counter);
+            return (u64)((counter.QuadPart / frequency.QuadPart) * 1000000000 + ((counter.QuadPart % frequency.QuadPart) * 1000000000) / frequency.QuadPart);
+        }
+
+        // Large pages on Windows have to be requested when the memory is allocated (MEM_LARGE_PAGES, which also
+        // requires the SeLockMemoryPrivilege) and cannot be committed piece by piece, so they do not fit the
+        // reserve/commit model of the allocator.
+        s8   hugepage_size_shift() { return 0; }
+        bool advise_hugepages(void* address, u64 size) { return false; }
+        bool memory_pressure(u32& some_avg10) { return false; }
+
+        u32 numa_node_count()
+        {
+            ULONG highest = 0;
+            if (!GetNumaHighestNodeNumber(&highest))
+                return 1;
+            return (u32)highest + 1;
+        }
+
+        u32 numa_current_node()
+        {
+            PROCESSOR_NUMBER processor;
+            USHORT           node = 0;
+            GetCurrentProcessorNumberEx(&processor);
+            if (!GetNumaProcessorNodeEx(&processor, &node) || node == 0xFFFF)
+                return 0;
+            return (u32)node;
+        }
+
+        // The preferred node of memory on Windows is given when the address range is reserved (VirtualAllocExNuma),
+        // it cannot be changed for a part of a range that is already reserved.
+        bool numa_bind(void* address, u64 size, u32 node) { return false; }
+
+        bool protect_pages(void* address, u64 size, bool read_only)
+        {
+            DWORD old_protect = 0;
+            return VirtualProtect(address, (SIZE_T)size, read_only ? PAGE_READONLY : PAGE_READWRITE, &old_protect) != 0;
+        }
+#else
+        u64 time_ms()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return ((u64)ts.tv_sec * 1000) + ((u64)ts.tv_nsec / 1000000);
+        }
+
+        u64 time_us()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return ((u64)ts.tv_sec * 1000000) + ((u64)ts.tv_nsec / 1000);
+        }
+
+        u64 time_ns()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return ((u64)ts.tv_sec * 1000000000) + (u64)ts.tv_nsec;
+        }
+
+        bool protect_pages(void* address, u64 size, bool read_only) { return mprotect(address, (size_t)size, read_only ? PROT_READ : (PROT_READ | PROT_WRITE)) == 0; }
+
+#    if defined(__linux__)
+        // Reads a small text file (sysfs) into 'buffer', returns the number of bytes read
+        static s32 read_text(const char* filename, char* buffer, s32 buffer_size)
+        {
+            s32 const fd = open(filename, O_RDONLY);
+            if (fd < 0)
+                return 0;
+            s32 const n = (s32)read(fd, buffer, buffer_size - 1);
+            close(fd);
+            buffer[n < 0 ? 0 : n] = 0;
+            return n < 0 ? 0 : n;
+        }
+
+        // The memory.pressure file of the cgroup v2 of the process, the path of the cgroup is on the '0::' line of
+        // /proc/self/cgroup (e.g. '0::/system.slice/app.service'). Returns false when there is no such line.
+        static bool cgroup_memory_pressure_path(char* path, s32 path_size)
+        {
+            char buffer[1024];
+            if (read_text("/proc/self/cgroup", buffer, sizeof(buffer)) == 0)
+                return false;
+
+            for (const char* line = buffer; *line != 0;)
+            {
+                if (line[0] == '0' && line[1] == ':' && line[2] == ':' && line[3] == '/')
+                {
+                    const char* cgroup = line + 3;
+                    const char* end    = cgroup;
+                    while (*end != 0 && *end != '\n')
+                        ++end;
+                    if (end[-1] == '/')
+                        --end;  // The root cgroup is '/'
+                    s32 const n = snprintf(path, (size_t)path_size, "/sys/fs/cgroup%.*s/memory.pressure", (int)(end - cgroup), cgroup);
+                    return n > 0 && n < path_size;
+                }
+                while (*line != 0 && *line != '\n')
+                    ++line;
+                if (*line == '\n')
+                    ++line;
+            }
+            return false;
+        }
+
+        bool memory_pressure(u32& some_avg10)
+        {
+            // The cgroup of the process when it runs in a cgroup v2 (containers, systemd services), otherwise the
+            // system wide value. The first line reads as 'some avg10=1.23 avg60=0.50 avg300=0.10 total=123456'.
+            char path[512];
+            char buffer[256];
+            bool const cgroup = cgroup_memory_pressure_path(path, sizeof(path)) && read_text(path, buffer, sizeof(buffer)) > 0;
+            if (!cgroup && read_text("/proc/pressure/memory", buffer, sizeof(buffer)) == 0)
+                return false;
+
+            const char* s = buffer;
+            for (const char* p = "some avg10="; *p != 0; ++p, ++s)
+            {
+                if (*s != *p)
+                    return false;
+            }
+
+            u32 value    = 0;
+            s32 decimals = -1;
+            for (; (*s >= '0' && *s <= '9') || (*s == '.' && decimals < 0); ++s)
+            {
+                if (*s == '.')
+                {
+                    decimals = 0;
+                    continue;
+                }
+                if (decimals >= 2)
+                    continue;
+                value = (value * 10) + (u32)(*s - '0');
+                if (decimals >= 0)
+                    decimals += 1;
+            }
+            for (decimals = decimals < 0 ? 0 : decimals; decimals < 2; ++decimals)
+                value *= 10;
+            some_avg10 = value;
+            return true;
+        }
+
+        u32 numa_node_count()
+        {
+            // A list of node ranges, e.g. '0-1' or '0,2-3', the highest node determines the count
+            char buffer[128];
+            if (read_text("/sys/devices/system/node/online", buffer, sizeof(buffer)) == 0)
+                return 1;
+            u32 highest = 0;
+            u32 value   = 0;
+            for (const char* s = buffer;; ++s)
+            {
+                if (*s >= '0' && *s <= '9')
+                {
+                    value = (value * 10) + (u32)(*s - '0');
+                    continue;
+                }
+                highest = value > highest ? value : highest;
+                value   = 0;
+                if (*s == 0)
+                    break;
+            }
+            return highest + 1;
+        }
+
+        u32 numa_current_node()
+        {
+            unsigned int cpu  = 0;
+            unsigned int node = 0;
+            if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+                return 0;
+            return (u32)node;
+        }
+
+        bool numa_bind(void* address, u64 size, u32 node)
+        {
+            // MPOL_BIND (2) with a single node in the mask, no dependency on libnuma
+            if (node >= 64)
+                return false;
+            unsigned long mask = 1ul << node;
+            return syscall(SYS_mbind, address, (unsigned long)size, 2, &mask, 64, 0) == 0;
+        }
+#    else
+        bool memory_pressure(u32& some_avg10) { return false; }
+        u32  numa_node_count() { return 1; }
+        u32  numa_current_node() { return 0; }
+        bool numa_bind(void* address, u64 size, u32 node) { return false; }
+#    endif
+
+#    if defined(__linux__) && defined(MADV_HUGEPAGE)
+        static s8 query_hugepage_size_shift()
+        {
+            // Transparent huge pages can be disabled system wide ('[never]')
+            char buffer[128];
+            if (read_text("/sys/kernel/mm/transparent_hugepage/enabled", buffer, sizeof(buffer)) == 0)
+                return 0;
+            for (const char* s = buffer; *s != 0; ++s)
+            {
+                if (s[0] == '[' && s[1] == 'n')
+                    return 0;
+            }
+
+            u64 size = 0;
+            if (read_text("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", buffer, sizeof(buffer)) > 0)
+            {
+                for (const char* s = buffer; *s >= '0' && *s <= '9'; ++s)
+                    size = (size * 10) + (u64)(*s - '0');
+            }
+            if (size == 0 || (size & (size - 1)) != 0)
+                return 0;
+
+            s8 shift = 0;
+            while (((u64)1 << shift) < size)
+                shift += 1;
+            return shift;
+        }
+
+        s8 hugepage_size_shift()
+        {
+            static s8 s_shift = -1;
+            if (s_shift < 0)
+                s_shift = query_hugepage_size_shift();
+            return s_shift;
+        }
+
+        bool advise_hugepages(void* address, u64 size) { return madvise(address, (size_t)size, MADV_HUGEPAGE) == 0; }
+#    else
+        s8   hugepage_size_shift() { return 0; }
+        bool advise_hugepages(void* address, u64 size) { return false; }
+#    endif
+#endif
+
+        void* file_open_write(const char* filepath)
+        {
+#if defined(_MSC_VER)
+            FILE* file = nullptr;
+            if (fopen_s(&file, filepath, "wb") != 0)
+                return nullptr;
+            return file;
+#else
+            return fopen(filepath, "wb");
+#endif
+        }
+
+        bool file_write(void* file, void const* data, u64 size) { return fwrite(data, 1, (size_t)size, (FILE*)file) == (size_t)size; }
+        void file_close(void* file) { fclose((FILE*)file); }
+
+        void fatal(const char* message)
+        {
+            fprintf(stderr, "csuperalloc fatal: %s\n", message);
+            fflush(stderr);
+            abort();
+        }
+    }  // namespace nplatform
+}  // namespace ncore
@@ -9,6 +9,8 @@
 #include "callocator/c_allocator_segment.h"
 
 #include "csuperalloc/private/c_list.h"
+#include "csuperalloc/private/c_multithread.h"
+#include "csuperalloc/private/c_platform.h"
 #include "csuperalloc/c_fsa.h"
 #include "csuperalloc/c_superalloc.h"
 #include "csuperalloc/c_superalloc_config.h"
@@ -17,12 +19,12 @@ namespace ncore
 {
     namespace nsuperalloc
     {
-        // @TODO: Deal with jittering between block checkout/release
-
 #define SUPERALLOC_DEBUG
 
         static inline void* toaddress(void* base, u64 offset) { return (void*)((ptr_t)base + offset); }
         static inline ptr_t todistance(void const* base, void const* ptr) { return (ptr_t)((ptr_t)ptr - (ptr_t)base); }
+        static inline u32   s_elem_alignment(binconfig_t const& bin) { return bin.m_alloc_size & (0 - bin.m_alloc_size); }  // Largest power-of-two dividing the element size
+        static inline bool  s_is_aligned(void const* ptr, u32 alignment) { return alignment <= 1 || ((ptr_t)ptr & (ptr_t)(alignment - 1)) == 0; }
 
         // superspace manages sections.
         // every section is *dedicated* to a particular chunk size and holds an array of chunks.
@@ -43,20 +45,29 @@ namespace ncore
         {
             struct section_t;
 
-            struct chunk_t
-            {
-                u16        m_elem_used_count;      // The number of elements used in this chunk
-                u16        m_elem_free_index;      // The index of the first free chunk (used to quickly take a free element)
-                u16        m_bin_index;            // The index of the bin that this chunk is used for
-                u16        m_section_chunk_index;  // index of this chunk in its section
-                u32        m_physical_pages;       // number of physical pages that this chunk has committed
-                u32        m_padding[1];           // padding
-                section_t* m_section;              // The section that this chunk belongs to
-                u32*       m_elem_tag_array;       // index to an array which we use for set_tag/get_tag
-                u64        m_elem_free_bin0;       // nbitvec12, bin0 and bin1 for free elements
-                u64*       m_elem_free_bin1;       //
-                chunk_t*   m_next;                 // next/prev for the doubly linked list
-                chunk_t*   m_prev;                 // next/prev for the doubly linked list
+            // Note: The first 64 bytes are only touched by the owner of the chunk, the second 64 bytes are
+            //       written by other threads when they free an element of this chunk. Keeping them on
+            //       separate cache-lines avoids ping-pong of the cache-line that the owner uses.
+            struct chunk_t  // 128 bytes
+            {
+                u16               m_elem_used_count;      // The number of elements used in this chunk
+                u16               m_elem_free_index;      // The index of the first free chunk (used to quickly take a free element)
+                u16               m_bin_index;            // The index of the bin that this chunk is used for
+                u16               m_section_chunk_index;  // index of this chunk in its section
+                u32               m_physical_pages;       // number of physical pages that this chunk has committed
+                u16               m_owner_index;          // index of the allocator instance that owns this chunk
+                u8                m_lifetime;             // lifetime hint of the elements of this chunk (lifetime_t)
+                u8                m_padding;              // padding
+                section_t*        m_section;              // The section that this chunk belongs to
+                u32*              m_elem_tag_array;       // index to an array which we use for set_tag/get_tag
+                u64               m_elem_free_bin0;       // nbitvec12, bin0 and bin1 for free elements
+                u64*              m_elem_free_bin1;       //
+                chunk_t*          m_next;                 // next/prev for the doubly linked list
+                chunk_t*          m_prev;                 // next/prev for the doubly linked list
+                void* volatile    m_deferred_list;        // elements freed by other threads (MPSC list through the elements)
+                chunk_t* volatile m_deferred_next;        // next chunk in the owner list of chunks that have deferred elements
+                u32*              m_elem_size_array;      // requested size per element, only when sizes are recorded (see vmalloc_t::record_sizes)
+                u64               m_deferred_padding[5];  // padding to a full cache-line
 
                 void clear()
                 {
@@ -66,15 +77,20 @@ namespace ncore
                     m_bin_index           = 0;
                     m_section             = nullptr;
                     m_physical_pages      = 0;
+                    m_owner_index         = 0;
+                    m_lifetime            = 0;
                     m_elem_tag_array      = nullptr;
                     m_elem_free_bin0      = 0;
                     m_elem_free_bin1      = nullptr;
                     m_next                = nullptr;
                     m_prev                = nullptr;
+                    m_deferred_list       = nullptr;
+                    m_deferred_next       = nullptr;
+                    m_elem_size_array     = nullptr;
                 }
             };
 
-            struct section_t  // 64 bytes
+            struct section_t
             {
                 section_t*    m_next;                 // managing a list of active, cached or used sections
                 section_t*    m_prev;                 //
@@ -87,8 +103,10 @@ namespace ncore
                 u16           m_count_chunks_cached;  // number of chunks that are cached
                 u16           m_count_chunks_used;    // number of chunks that are in use
                 u16           m_count_chunks_max;     // maximum number of chunks that can be used in this segment
-                u32           m_padding;              // padding
+                u16           m_lifetime;             // lifetime hint of the chunks that are checked out from this section
+                u16           m_padding;              // padding
                 chunkconfig_t m_chunk_config;         // chunk config
+                u64           m_release_time;         // time (ms) at which this section became empty (when cached)
 
                 void clear()
                 {
@@ -103,63 +121,198 @@ namespace ncore
                     m_count_chunks_cached = 0;
                     m_count_chunks_used   = 0;
                     m_count_chunks_max    = 0;
+                    m_lifetime            = 0;
+                    m_release_time        = 0;
                 }
             };
 
+            // Book-keeping of the cached chunks of a chunk config, the maximum is derived from chunkconfig_t::m_cacheshift
+            struct chunkcache_t
+            {
+                u32 m_count;  // number of chunks currently cached
+                u32 m_max;    // maximum number of chunks that can be cached
+                u32 m_pages;  // number of committed pages held by the cached chunks
+                u32 m_padding;
+            };
+
+            // Usage counters of a chunk config, reported by get_stats
+            struct chunkusage_t
+            {
+                u32 m_chunks_used;      // number of chunks that hold elements
+                u32 m_committed_pages;  // number of committed pages of all chunks (used and cached)
+                u32 m_sections_used;    // number of sections that are not in the section cache
+                u32 m_padding;
+            };
+
+            // Book-keeping of the empty sections of a chunk config that are kept around for reuse, this
+            // avoids jittering between section checkout/release when a single chunk is repeatedly
+            // obtained and released. The list is ordered by release time, oldest first.
+            struct sectioncache_t
+            {
+                section_t* m_sections;  // list of cached (empty) sections
+                u32        m_count;     // number of sections in the list
+                u32        m_padding;
+            };
+
+            // Note: The superspace can be shared by multiple allocator instances (e.g. one per thread), all
+            //       functions that modify sections or chunks are guarded by m_lock. Chunk metadata that is
+            //       shared (chunk_t, section chunk arrays) is allocated from the superspace fsa, while the
+            //       per-element data of a chunk (tag array, binmap) is allocated from the fsa of the owner.
             struct alloc_t
             {
                 config_t const* m_config;               //
+                backend_t*      m_backend;              // Reserves and (de)commits the managed memory
+                fsa_t*          m_fsa;                  // fsa for chunk_t and section data
+                spinlock_t      m_lock;                 // guards sections and chunks
+                byte*           m_address_reserved;     // The reserved address range, m_address_base is aligned within it
                 byte*           m_address_base;         //
                 u64             m_address_range;        //
                 u32             m_used_physical_pages;  // The number of pages that are currently committed
                 s8              m_page_size_shift;      //
+                s8              m_hugepage_size_shift;  // 0 when huge pages are not available
+                bool            m_tagless;              // Chunks have no element tag array, set_tag/get_tag are not supported
+                bool            m_record_sizes;         // Chunks that are checked out get an array with the requested size per element
+                bool            m_address_owned;        // The address range was reserved by this superspace (not a region of a supermemory_t)
+                bool            m_os_memory;            // The backend is the OS, huge page advice, NUMA binding and protection apply
+                u8              m_region_pages;         // region_t::cPagesDefault, cPagesSmall or cPagesHuge
+                u8              m_region_protect;       // region_t::cProtectReadWrite or cProtectReadOnly, applies to every committed page
+                u16             m_next_owner_index;     // Owner index of the next child or region heap, see new_owner_index
+
+                // Memory pressure, polled when a chunk is checked out (see vmalloc_t::set_pressure_source)
+                pressure_fn  m_pressure_fn;           // Set under m_lock, read under m_lock by poll_pressure
+                void*        m_pressure_user;         //
+                s32 volatile m_pressure_enabled;      // 1 when a source is set, checked without m_lock before polling
+                u64 volatile m_pressure_poll_time;    // Time (ms) of the last poll, claimed with a CAS by the polling thread
+                u32 volatile m_pressure_interval_ms;  // Minimum time between two polls
+
+                // Chunks of the aligned bins (a single element per chunk)
+                u32 m_aligned_count;  // Number of chunks in use
+                u32 m_aligned_pages;  // Number of pages committed by them
+                u64 m_aligned_size;   // Address space (bytes) covered by them
 
                 // Chunks
-                chunk_t** m_chunk_active_array;  // These are chunk list heads, one list head per chunk type
+                chunk_t**     m_chunk_active_array;  // These are chunk list heads, one list head per chunk type
+                chunkcache_t* m_chunk_cache;         // Cached chunk book-keeping, one per chunk config
+                chunkusage_t* m_chunk_usage;         // Usage counters, one per chunk config
 
                 // Sections
-                section_t**     m_section_active_array;     // This needs to be per section config
-                s8              m_section_minsize_shift;    // The minimum size of a section in log2
-                s8              m_section_maxsize_shift;    // 1 << m_section_maxsize_shift = segment size
-                segment_alloc_t m_section_allocator;        // Allocator for obtaining a new section with a power-of-two size
-                u16*            m_section_map;              // This a full memory mapping of index to section_t* (16 bits)
-                u32             m_sections_array_capacity;  // The capacity of sections array
-                u32             m_sections_free_index;      // Lower bound index of free sections
-                section_t*      m_section_free_list;        // List of free sections
-                section_t*      m_sections_array;           // Array of sections ()
+                section_t**      m_section_active_array;     // Sections with free chunks, one list per node, lifetime and chunk config
+                sectioncache_t*  m_section_cache;            // Empty sections kept for reuse, one per node and chunk config
+                s8               m_section_minsize_shift;    // The minimum size of a section in log2
+                s8               m_section_maxsize_shift;    // 1 << m_section_maxsize_shift = segment size
+                segment_alloc_t* m_section_allocators;       // Allocator for obtaining a new section with a power-of-two size, one per node
+                u16*             m_section_map;              // This a full memory mapping of index to section_t* (16 bits)
+                u32              m_sections_array_capacity;  // The capacity of sections array
+                u32              m_sections_free_index;      // Lower bound index of free sections
+                section_t*       m_section_free_list;        // List of free sections
+                section_t*       m_sections_array;           // Array of sections ()
+
+                // NUMA, the address space is split into one range per node (a single node when NUMA mode is off)
+                u32          m_num_nodes;         //
+                s8           m_node_range_shift;  // 1 << m_node_range_shift = the size of the address range of a node
+                bool         m_numa_bind;         // Committed pages are bound to the node of their range (mbind)
+                numa_node_fn m_node_fn;           // A fake topology, the node of the calling thread
+                void*        m_node_user;         //
+
+                // The instances of a threaded context own their chunks under their thread index, which stays below
+                // cFirstOwnerIndex. Child and region heaps get an owner index counting down from cLastOwnerIndex.
+                enum
+                {
+                    cFirstOwnerIndex = 0x8000,
+                    cLastOwnerIndex  = 0xFFFF,
+                };
 
                 DCORE_CLASS_PLACEMENT_NEW_DELETE
 
                 alloc_t()
                     : m_config(nullptr)
+                    , m_backend(nullptr)
+                    , m_fsa(nullptr)
+                    , m_address_reserved(nullptr)
                     , m_address_base(nullptr)
                     , m_address_range(0)
                     , m_used_physical_pages(0)
                     , m_page_size_shift(0)
+                    , m_hugepage_size_shift(0)
+                    , m_tagless(false)
+                    , m_record_sizes(false)
+                    , m_address_owned(false)
+                    , m_os_memory(true)
+                    , m_region_pages(region_t::cPagesDefault)
+                    , m_region_protect(region_t::cProtectReadWrite)
+                    , m_next_owner_index(cLastOwnerIndex)
+                    , m_pressure_fn(nullptr)
+                    , m_pressure_user(nullptr)
+                    , m_pressure_enabled(0)
+                    , m_pressure_poll_time(0)
+                    , m_pressure_interval_ms(0)
+                    , m_aligned_count(0)
+                    , m_aligned_pages(0)
+                    , m_aligned_size(0)
                     , m_chunk_active_array(nullptr)
+                    , m_chunk_cache(nullptr)
+                    , m_chunk_usage(nullptr)
                     , m_section_active_array(nullptr)
+                    , m_section_cache(nullptr)
                     , m_section_minsize_shift(0)
                     , m_section_maxsize_shift(0)
+                    , m_section_allocators(nullptr)
                     , m_section_map(nullptr)
                     , m_sections_array_capacity(0)
                     , m_sections_free_index(0)
                     , m_section_free_list(nullptr)
                     , m_sections_array(nullptr)
+                    , m_num_nodes(1)
+                    , m_node_range_shift(0)
+                    , m_numa_bind(false)
+                    , m_node_fn(nullptr)
+                    , m_node_user(nullptr)
                 {
                 }
 
-                void initialize(config_t const* config, arena_t* heap, fsa_t* fsa)
+                // Note: 'numa' is nullptr when NUMA mode is off, 'region' and 'region_address' are nullptr unless the
+                //       superspace is a region of a supermemory_t, which reserves the (aligned) address range.
+                void initialize(config_t const* config, arena_t* heap, fsa_t* fsa, bool tagless, numa_t const* numa, region_t const* region, byte* region_address, backend_t* backend)
                 {
                     ASSERT(math::ispo2(config->m_total_address_size));
 
-                    m_address_range = config->m_total_address_size;
-                    m_address_base  = (byte*)v_alloc_reserve(m_address_range);
+                    // The base address is aligned to the maximum section size, sections are handed out by the segment
+                    // allocator at offsets that are a multiple of their (power-of-two) size, so every section is aligned
+                    // to its size and every chunk to its size. The alignment guarantees of the bins rely on this.
+                    u64 const section_maxsize = (u64)1 << config->m_section_maxsize_shift;
+                    m_address_range           = config->m_total_address_size;
+                    m_backend                 = backend;
+                    m_os_memory               = backend == gOsBackend();
+                    m_address_owned           = region_address == nullptr;
+                    m_address_reserved        = m_address_owned ? (byte*)m_backend->reserve(m_address_range + section_maxsize) : region_address;
+                    m_address_base            = (byte*)(((ptr_t)m_address_reserved + (section_maxsize - 1)) & ~(ptr_t)(section_maxsize - 1));
+                    m_region_pages            = (region != nullptr) ? region->m_pages : (u8)region_t::cPagesDefault;
+                    m_region_protect          = (region != nullptr) ? region->m_protect : (u8)region_t::cProtectReadWrite;
+                    m_aligned_count           = 0;
+                    m_aligned_pages           = 0;
+                    m_aligned_size            = 0;
+                    m_lock.initialize();
                     // const u32 page_size       = v_alloc_get_page_size();
-                    m_section_active_array    = g_allocate_array_and_clear<section_t*>(heap, config->m_num_chunkconfigs);
+                    initialize_numa(numa, config);
+                    m_section_active_array    = g_allocate_array_and_clear<section_t*>(heap, m_num_nodes * cLifetimeCount * config->m_num_chunkconfigs);
                     m_chunk_active_array      = g_allocate_array_and_clear<chunk_t*>(heap, config->m_num_chunkconfigs);
+                    m_chunk_cache             = g_allocate_array_and_clear<chunkcache_t>(heap, config->m_num_chunkconfigs);
+                    m_chunk_usage             = g_allocate_array_and_clear<chunkusage_t>(heap, config->m_num_chunkconfigs);
+                    m_section_cache           = g_allocate_array_and_clear<sectioncache_t>(heap, m_num_nodes * config->m_num_chunkconfigs);
+                    m_section_allocators      = g_allocate_array_and_clear<segment_alloc_t>(heap, m_num_nodes);
                     m_config                  = config;
+                    m_fsa                     = fsa;
                     m_used_physical_pages     = 0;
-                    m_page_size_shift         = v_alloc_get_page_size_shift();
+                    m_page_size_shift         = m_backend->page_size_shift();
+                    m_hugepage_size_shift     = m_os_memory ? nplatform::hugepage_size_shift() : 0;
+                    m_tagless                 = tagless;
+                    m_record_sizes            = false;
+                    m_pressure_fn             = nullptr;
+                    m_pressure_user           = nullptr;
+                    m_pressure_enabled        = 0;
+                    m_pressure_poll_time      = 0;
+                    m_pressure_interval_ms    = 0;
+                    m_next_owner_index        = cLastOwnerIndex;
                     m_section_minsize_shift   = config->m_section_minsize_shift;
                     m_section_maxsize_shift   = config->m_section_maxsize_shift;
                     m_section_map             = g_allocate_array_and_fill<u16>(heap, (u32)(m_address_range >> m_section_minsize_shift), 0xFFFFFFFF);
@@ -168,43 +321,143 @@ namespace ncore
                     m_section_free_list       = nullptr;
                     m_sections_array          = g_allocate_array_and_clear<section_t>(heap, m_sections_array_capacity);
 
+                    for (s16 i = 0; i < config->m_num_chunkconfigs; i++)
+                    {
+                        chunkconfig_t const& chunk_config  = config->m_achunkconfigs[i];
+                        m_chunk_cache[i].m_count           = 0;
+                        m_chunk_cache[i].m_max             = (chunk_config.m_cacheshift < 0) ? 0 : ((u32)1 << chunk_config.m_cacheshift);
+                        m_chunk_cache[i].m_pages           = 0;
+                        m_chunk_usage[i].m_chunks_used     = 0;
+                        m_chunk_usage[i].m_committed_pages = 0;
+                        m_chunk_usage[i].m_sections_used   = 0;
+                    }
+                    for (u32 i = 0; i < m_num_nodes * config->m_num_chunkconfigs; i++)
+                    {
+                        m_section_cache[i].m_sections = nullptr;
+                        m_section_cache[i].m_count    = 0;
+                    }
+
                     arena_alloc_t heap_alloc(heap);
-                    nsegment::initialize(&m_section_allocator, &heap_alloc, (int_t)1 << m_section_minsize_shift, (int_t)1 << m_section_maxsize_shift, (int_t)m_address_range);
+                    for (u32 n = 0; n < m_num_nodes; n++)
+                        nsegment::initialize(&m_section_allocators[n], &heap_alloc, (int_t)1 << m_section_minsize_shift, (int_t)1 << m_section_maxsize_shift, (int_t)1 << m_node_range_shift);
+                }
+
+                // Every node gets an equal, power-of-two sized part of the address space, so the node of an address
+                // is a shift and address_to_chunk does not change. Nodes beyond the power-of-two have no range.
+                void initialize_numa(numa_t const* numa, config_t const* config)
+                {
+                    m_num_nodes        = 1;
+                    m_node_range_shift = math::ilog2(config->m_total_address_size);
+                    m_numa_bind        = false;
+                    m_node_fn          = nullptr;
+                    m_node_user        = nullptr;
+                    if (numa == nullptr)
+                        return;
+
+                    u32 num_nodes = numa->m_num_nodes;
+                    if (num_nodes == 0)
+                        num_nodes = (numa->m_node_fn == nullptr) ? nplatform::numa_node_count() : 1;
+                    num_nodes = math::min(num_nodes, (u32)numa_t::cMaxNodes);
+
+                    // A node range has to hold at least one section of the maximum size
+                    s8 range_shift = m_node_range_shift;
+                    while (((u32)1 << (m_node_range_shift - range_shift)) < num_nodes && range_shift > config->m_section_maxsize_shift)
+                        range_shift -= 1;
+                    num_nodes = math::min(num_nodes, (u32)1 << (m_node_range_shift - range_shift));
+                    if (num_nodes <= 1)
+                        return;
+
+                    m_num_nodes        = num_nodes;
+                    m_node_range_shift = range_shift;
+                    m_numa_bind        = numa->m_node_fn == nullptr;
+                    m_node_fn          = numa->m_node_fn;
+                    m_node_user        = numa->m_node_user;
                 }
 
+                // The node of the calling thread
+                inline u32 current_node() const
+                {
+                    if (m_num_nodes <= 1)
+                        return 0;
+                    u32 const node = (m_node_fn != nullptr) ? m_node_fn(m_node_user) : nplatform::numa_current_node();
+                    return node < m_num_nodes ? node : (node % m_num_nodes);
+                }
+
+                inline u32 section_node(section_t const* section) const { return (u32)(todistance(m_address_base, section->m_section_address) >> m_node_range_shift); }
+
+                // Index into m_section_cache, an empty section can be reused for any lifetime
+                inline u32 section_list_index(u32 node, chunkconfig_t const& chunk_config) const { return (node * m_config->m_num_chunkconfigs) + chunk_config.m_chunkconfig_index; }
+
+                // Index into m_section_active_array, chunks of different lifetimes do not share a section
+                inline u32 section_active_index(u32 node, u32 lifetime, chunkconfig_t const& chunk_config) const { return (((node * cLifetimeCount) + lifetime) * m_config->m_num_chunkconfigs) + chunk_config.m_chunkconfig_index; }
+                inline u32 section_active_index(section_t const* section) const { return section_active_index(section_node(section), section->m_lifetime, section->m_chunk_config); }
+
                 void deinitialize(arena_t* heap)
                 {
-                    v_alloc_release(m_address_base, m_address_range);
+                    if (m_address_owned)
+                        m_backend->release(m_address_reserved, m_address_range + ((u64)1 << m_section_maxsize_shift));
 
                     g_deallocate(heap, m_section_active_array);
                     g_deallocate(heap, m_chunk_active_array);
+                    g_deallocate(heap, m_chunk_cache);
+                    g_deallocate(heap, m_chunk_usage);
+                    g_deallocate(heap, m_section_cache);
+                    g_deallocate(heap, m_section_allocators);
                     g_deallocate(heap, m_sections_array);
 
+                    m_address_reserved      = nullptr;
                     m_address_base          = nullptr;
                     m_address_range         = 0;
                     m_page_size_shift       = 0;
+                    m_hugepage_size_shift   = 0;
                     m_section_maxsize_shift = 0;
                     m_used_physical_pages   = 0;
+                    m_section_allocators    = nullptr;
+                    m_num_nodes             = 1;
                     m_config                = nullptr;
+                    m_fsa                   = nullptr;
                 }
 
                 inline static u32 s_chunk_physical_pages(binconfig_t const& bin, s8 page_size_shift) { return (u32)((bin.m_alloc_size * bin.m_max_alloc_count) + (((u64)1 << page_size_shift) - 1)) >> page_size_shift; }
 
-                chunk_t* checkout_chunk(u8 bin_index, fsa_t* fsa)
+                inline static bool s_is_aligned_bin(config_t const* config, u16 bin_index) { return bin_index >= config->m_alignedbin_index && bin_index < config->m_num_binconfigs; }
+
+                // The pages that hold the first 'elem_count' elements of a chunk
+                inline static u32 s_elem_physical_pages(binconfig_t const& bin, u32 elem_count, s8 page_size_shift) { return (u32)((((u64)bin.m_alloc_size * elem_count) + (((u64)1 << page_size_shift) - 1)) >> page_size_shift); }
+
+                // Pages of a chunk are committed as the elements are taken (see grow_chunk), a chunk starts with the
+                // pages of its first element. A cached chunk keeps what it has committed, up to what the bin can use.
+                // Returns nullptr when the backend fails to commit the pages.
+                // Note: 'fsa' is the fsa of the allocator instance that will own the chunk
+                chunk_t* checkout_chunk(u8 bin_index, lifetime_t lifetime, fsa_t* fsa)
                 {
+                    binconfig_t const& bin = m_config->m_abinconfigs[bin_index];
+                    return checkout_chunk(bin_index, lifetime, fsa, s_elem_physical_pages(bin, 1, m_page_size_shift), s_chunk_physical_pages(bin, m_page_size_shift));
+                }
+
+                // Note: 'required_physical_pages' is the number of pages to commit from the start of the chunk, pages
+                //       that are already committed (cached chunk) are kept up to 'max_physical_pages'.
+                chunk_t* checkout_chunk(u8 bin_index, lifetime_t lifetime, fsa_t* fsa, u32 required_physical_pages, u32 max_physical_pages)
+                {
+                    if (natomic::load_s32(&m_pressure_enabled) != 0)  // Only a hint, poll_pressure reads the source under the lock
+                        poll_pressure();
+
+                    scoped_spinlock_t lock(m_lock);
+
                     chunk_t* chunk = nullptr;
 
                     binconfig_t const& bin = m_config->m_abinconfigs[bin_index];
+                    ASSERT(((u64)required_physical_pages << m_page_size_shift) <= ((u64)1 << bin.m_chunk_config.m_sizeshift));
 
-                    // Get the section for this chunk (note: a section is locked to a certain chunk size)
-                    section_t* section = ll_pop(m_section_active_array[bin.m_chunk_config.m_chunkconfig_index]);
+                    // Get the section for this chunk (note: a section is locked to a certain chunk size, node and lifetime)
+                    u32 const  node    = current_node();
+                    section_t* section = ll_pop(m_section_active_array[section_active_index(node, lifetime, bin.m_chunk_config)]);
                     if (section == nullptr)
                     {
-                        section = checkout_section(bin.m_chunk_config, fsa);
+                        section = checkout_section(bin.m_chunk_config, node, lifetime);
                     }
 
-                    u32 const required_physical_pages = s_chunk_physical_pages(bin, m_page_size_shift);
-                    u32       already_committed_pages = 0;
+                    u32 already_committed_pages = 0;
 
                     // We have a section, now obtain a chunk from this section
                     if (section->m_count_chunks_cached > 0)
@@ -212,10 +465,14 @@ namespace ncore
                         section->m_count_chunks_cached -= 1;
                         chunk                   = ll_pop(section->m_chunks_cached_list);
                         already_committed_pages = chunk->m_physical_pages;
+
+                        chunkcache_t& cache = m_chunk_cache[section->m_chunk_config.m_chunkconfig_index];
+                        cache.m_count -= 1;
+                        cache.m_pages -= already_committed_pages;
                     }
                     else
                     {
-                        chunk = g_allocate<chunk_t>(fsa);
+                        chunk = g_allocate<chunk_t>(m_fsa);
                         chunk->clear();
 
                         s32 const section_chunk_index = nbitvec12::find_and_remove(&section->m_chunks_free_bin0, section->m_chunks_free_bin1, section->m_count_chunks_max);
@@ -235,8 +492,11 @@ namespace ncore
 
                     {  // Initialize the chunk
                         chunk->m_section        = section;
-                        chunk->m_bin_index      = bin_index;                                          // The bin configuration
-                        chunk->m_elem_tag_array = g_allocate_array<u32>(fsa, bin.m_max_alloc_count);  // Allocate allocation tag array
+                        chunk->m_bin_index      = bin_index;  // The bin configuration
+                        chunk->m_lifetime       = (u8)lifetime;
+                        chunk->m_elem_tag_array = m_tagless ? nullptr : g_allocate_array<u32>(fsa, bin.m_max_alloc_count);
+                        if (m_record_sizes)
+                            chunk->m_elem_size_array = g_allocate_array<u32>(fsa, bin.m_max_alloc_count);
 
                         // Allocate and initialize the binmap for tracking free elements.
                         // We are initializing the binmap with all elements being used, since
@@ -249,101 +509,254 @@ namespace ncore
                     }
 
                     // Make sure that only the required physical pages are committed
+                    ASSERT(chunk->m_physical_pages == already_committed_pages);
+                    bool const committed = commit_chunk_pages(chunk, math::min(math::max(already_committed_pages, required_physical_pages), max_physical_pages));
+
+                    if (s_is_aligned_bin(m_config, bin_index))
+                    {
+                        m_aligned_count += 1;
+                        m_aligned_pages += chunk->m_physical_pages;
+                        m_aligned_size += (u64)1 << bin.m_chunk_config.m_sizeshift;
+                    }
+
+                    m_chunk_usage[section->m_chunk_config.m_chunkconfig_index].m_chunks_used += 1;
+
+                    section->m_count_chunks_used += 1;
+                    if (section->m_count_chunks_used < section->m_count_chunks_max)
+                    {
+                        // Section still has free chunks, add it back to the active list
+                        ll_insert(m_section_active_array[section_active_index(section)], section);
+                    }
+
+                    if (!committed)
+                    {
+                        // Out of memory, the chunk goes back to the section with the pages it already had
+                        release_chunk_locked(chunk, fsa);
+                        return nullptr;
+                    }
+                    return chunk;
+                }
+
+                // Number of pages in a huge page when the chunk config is backed by huge pages, otherwise 1. The pages
+                // setting of a region overrides the setting of the chunk config.
+                inline u32 commit_granularity(chunkconfig_t const& chunk_config) const
+                {
+                    bool const hugepage = (m_region_pages == region_t::cPagesHuge) || (chunk_config.m_hugepage != 0 && m_region_pages == region_t::cPagesDefault);
+                    if (!hugepage || m_hugepage_size_shift <= m_page_size_shift || m_hugepage_size_shift > chunk_config.m_sizeshift)
+                        return 1;
+                    return (u32)1 << (m_hugepage_size_shift - m_page_size_shift);
+                }
+
+                // Commits or decommits the tail pages of a chunk so that 'required_physical_pages', rounded up to the
+                // commit granularity of the chunk config, are committed. Returns false when the backend fails to commit,
+                // the chunk then keeps the pages it had.
+                // Note: The caller holds m_lock
+                bool commit_chunk_pages(chunk_t* chunk, u32 required_physical_pages)
+                {
+                    chunkconfig_t const& chunk_config = chunk->m_section->m_chunk_config;
+                    u32 const            granularity  = commit_granularity(chunk_config);
+                    required_physical_pages           = (required_physical_pages + (granularity - 1)) & ~(granularity - 1);
+
+                    u32 const     already_committed_pages = chunk->m_physical_pages;
+                    chunkusage_t& usage                   = m_chunk_usage[chunk_config.m_chunkconfig_index];
                     if (required_physical_pages < already_committed_pages)
                     {
                         // Overcommitted, uncommit tail pages
                         void* address = chunk_to_address(chunk);
                         address       = toaddress(address, (u64)required_physical_pages << m_page_size_shift);
-                        v_alloc_decommit(address, ((u64)1 << m_page_size_shift) * (u64)(already_committed_pages - required_physical_pages));
+                        m_backend->decommit(address, ((u64)1 << m_page_size_shift) * (u64)(already_committed_pages - required_physical_pages));
                         chunk->m_physical_pages = required_physical_pages;
                         m_used_physical_pages -= (already_committed_pages - required_physical_pages);
+                        usage.m_committed_pages -= (already_committed_pages - required_physical_pages);
                     }
                     else if (required_physical_pages > already_committed_pages)
                     {
                         // Undercommitted, commit necessary tail pages
                         void* address = chunk_to_address(chunk);
                         address       = toaddress(address, (u64)already_committed_pages << m_page_size_shift);
-                        v_alloc_commit(address, ((u64)1 << m_page_size_shift) * (u64)(required_physical_pages - already_committed_pages));
+                        if (!m_backend->commit(address, ((u64)1 << m_page_size_shift) * (u64)(required_physical_pages - already_committed_pages)))
+                            return false;
+                        if (granularity > 1)
+                            nplatform::advise_hugepages(address, ((u64)1 << m_page_size_shift) * (u64)(required_physical_pages - already_committed_pages));
+                        if (m_numa_bind && m_os_memory)
+                            nplatform::numa_bind(address, ((u64)1 << m_page_size_shift) * (u64)(required_physical_pages - already_committed_pages), section_node(chunk->m_section));
+                        if (m_region_protect != region_t::cProtectReadWrite && m_os_memory)
+                            nplatform::protect_pages(address, ((u64)1 << m_page_size_shift) * (u64)(required_physical_pages - already_committed_pages), true);
                         chunk->m_physical_pages = required_physical_pages;
                         m_used_physical_pages += (required_physical_pages - already_committed_pages);
+                        usage.m_committed_pages += (required_physical_pages - already_committed_pages);
                     }
+                    return true;
+                }
 
-                    section->m_count_chunks_used += 1;
-                    if (section->m_count_chunks_used < section->m_count_chunks_max)
-                    {
-                        // Section still has free chunks, add it back to the active list
-                        ll_insert(m_section_active_array[section->m_chunk_config.m_chunkconfig_index], section);
-                    }
+                // Resizes the committed part of a chunk of an aligned bin (single element), this is how such
+                // an allocation grows or shrinks in place. Returns false when the backend fails to commit.
+                bool resize_chunk(chunk_t* chunk, u32 required_physical_pages)
+                {
+                    scoped_spinlock_t lock(m_lock);
+                    ASSERT(s_is_aligned_bin(m_config, chunk->m_bin_index));
+                    ASSERT(((u64)required_physical_pages << m_page_size_shift) <= ((u64)1 << chunk->m_section->m_chunk_config.m_sizeshift));
+
+                    m_aligned_pages -= chunk->m_physical_pages;
+                    bool const committed = commit_chunk_pages(chunk, required_physical_pages);
+                    m_aligned_pages += chunk->m_physical_pages;
+                    return committed;
+                }
 
-                    return chunk;
+                // Commits the pages for the first 'elem_count' elements of a chunk, called by the owner when the high-water
+                // mark (m_elem_free_index) crosses into pages that are not committed yet. To limit the number of calls
+                // the committed part at least doubles, up to the whole chunk. When that fails only the pages of the
+                // elements are committed, returns false when the backend fails to commit those.
+                bool grow_chunk(chunk_t* chunk, binconfig_t const& bin, u32 elem_count)
+                {
+                    scoped_spinlock_t lock(m_lock);
+                    ASSERT(!s_is_aligned_bin(m_config, chunk->m_bin_index));
+
+                    u32 const full_pages     = s_chunk_physical_pages(bin, m_page_size_shift);
+                    u32 const required_pages = s_elem_physical_pages(bin, elem_count, m_page_size_shift);
+                    u32 const grown_pages    = math::max(required_pages, math::min(chunk->m_physical_pages * 2, full_pages));
+                    if (commit_chunk_pages(chunk, grown_pages))
+                        return true;
+                    return grown_pages > required_pages && commit_chunk_pages(chunk, required_pages);
                 }
 
+                // Note: 'fsa' is the fsa of the allocator instance that owns the chunk
                 void release_chunk(chunk_t* chunk, fsa_t* fsa)
                 {
+                    scoped_spinlock_t lock(m_lock);
+                    release_chunk_locked(chunk, fsa);
+                }
+
+                // Releases every chunk in 'lists' under a single lock, the elements that are still in use are
+                // discarded. The lists are empty afterwards.
+                void release_chunks(chunk_t** lists, u32 num_lists, fsa_t* fsa)
+                {
+                    scoped_spinlock_t lock(m_lock);
+                    for (u32 i = 0; i < num_lists; ++i)
+                    {
+                        chunk_t* chunk = ll_pop(lists[i]);
+                        while (chunk != nullptr)
+                        {
+                            release_chunk_locked(chunk, fsa);
+                            chunk = ll_pop(lists[i]);
+                        }
+                    }
+                }
+
+                void release_chunk_locked(chunk_t* chunk, fsa_t* fsa)
+                {
+                    ASSERT(chunk->m_deferred_list == nullptr && chunk->m_deferred_next == nullptr);
+
                     // See if this segment was full, if so we need to add it back to the list of active segments again so that
                     // we can checkout chunks from it again.
                     section_t* const section = chunk->m_section;
                     if (section->m_count_chunks_used == section->m_count_chunks_max)
                     {
-                        ll_insert(m_section_active_array[section->m_chunk_config.m_chunkconfig_index], section);
+                        ll_insert(m_section_active_array[section_active_index(section)], section);
+                    }
+
+                    if (s_is_aligned_bin(m_config, chunk->m_bin_index))
+                    {
+                        m_aligned_count -= 1;
+                        m_aligned_pages -= chunk->m_physical_pages;
+                        m_aligned_size -= (u64)1 << section->m_chunk_config.m_sizeshift;
                     }
 
                     // Release any resources allocated for this chunk
                     {
                         nfsa::deallocate(fsa, chunk->m_elem_tag_array);
                         nfsa::deallocate(fsa, chunk->m_elem_free_bin1);
-                        chunk->m_elem_tag_array = nullptr;
-                        chunk->m_elem_free_bin1 = nullptr;
+                        if (chunk->m_elem_size_array != nullptr)
+                            nfsa::deallocate(fsa, chunk->m_elem_size_array);
+                        chunk->m_elem_tag_array  = nullptr;
+                        chunk->m_elem_free_bin1  = nullptr;
+                        chunk->m_elem_size_array = nullptr;
 
                         chunk->m_bin_index       = -1;
                         chunk->m_elem_used_count = 0;
                         chunk->m_elem_free_index = 0;
                     }
 
-                    // TODO: Caching of chunks, should we make this part of the configuration where a
-                    // chunk/section configuration specifies how many chunks to cache?
-                    bool const cache_chunk = true;
+                    chunkusage_t& usage = m_chunk_usage[section->m_chunk_config.m_chunkconfig_index];
+                    usage.m_chunks_used -= 1;
+
+                    // Chunks are cached (kept committed) up to the limit of the chunk config, beyond that
+                    // the chunk is decommitted and given back to the section.
+                    chunkcache_t& cache       = m_chunk_cache[section->m_chunk_config.m_chunkconfig_index];
+                    bool const    cache_chunk = cache.m_count < cache.m_max;
                     if (cache_chunk)
                     {
                         // Cache the chunk
                         ll_insert(section->m_chunks_cached_list, chunk);
                         section->m_count_chunks_used -= 1;
                         section->m_count_chunks_cached += 1;
+                        cache.m_count += 1;
+                        cache.m_pages += chunk->m_physical_pages;
+
+                        if (section->m_count_chunks_used == 0)
+                        {
+                            // This section is now empty (except for cached chunks), release it
+                            release_section(section);
+                        }
                     }
                     else
                     {
                         // Uncommit the virtual memory of this chunk
-                        v_alloc_decommit(chunk_to_address(chunk), ((u32)1 << m_page_size_shift) * chunk->m_physical_pages);
+                        m_backend->decommit(chunk_to_address(chunk), ((u64)1 << m_page_size_shift) * chunk->m_physical_pages);
                         m_used_physical_pages -= chunk->m_physical_pages;
+                        usage.m_committed_pages -= chunk->m_physical_pages;
 
                         // Mark this chunk in the binmap as free
                         nbitvec12::clr(&section->m_chunks_free_bin0, section->m_chunks_free_bin1, section->m_count_chunks_max, chunk->m_section_chunk_index);
 
                         // Deallocate and unregister the chunk
                         section->m_chunk_array[chunk->m_section_chunk_index] = nullptr;
-                        nfsa::deallocate(fsa, chunk);
+                        nfsa::deallocate(m_fsa, chunk);
                         chunk = nullptr;
 
                         section->m_count_chunks_used -= 1;
                         if (section->m_count_chunks_used == 0)
                         {
                             // This section is now empty, we need to release it
-                            release_section(section, fsa);
+                            release_section(section);
                         }
                     }
                 }
 
-                section_t* checkout_section(chunkconfig_t const& chunk_config, fsa_t* fsa)
+                section_t* checkout_section(chunkconfig_t const& chunk_config, u32 node, lifetime_t lifetime)
                 {
+                    // Reuse the most recently released section of this chunk config, it is still fully set up
+                    sectioncache_t& section_cache = m_section_cache[section_list_index(node, chunk_config)];
+                    if (section_cache.m_sections != nullptr)
+                    {
+                        section_t* section = section_cache.m_sections->m_prev;
+                        ll_remove(section_cache.m_sections, section);
+                        section_cache.m_count -= 1;
+                        section->m_release_time = 0;
+                        section->m_lifetime     = (u16)lifetime;
+                        evict_sections(section_cache, nplatform::time_ms());
+                        m_chunk_usage[chunk_config.m_chunkconfig_index].m_sections_used += 1;
+                        return section;
+                    }
+
                     // section allocator, we are allocating number of nodes, where each node has the size
                     // equal to (1 << m_section_minsize_shift) so the number of nodes is equal to size:
                     // size = 'number of nodes' * (1 << m_section_minsize_shift)
                     ASSERT(chunk_config.m_section_sizeshift >= m_section_minsize_shift && chunk_config.m_section_sizeshift <= m_section_maxsize_shift);
 
                     // num nodes we need to allocate = (1 << sectionconfig.m_sizeshift) / (1 << m_section_minsize_shift)
+                    // When the range of the node is exhausted the section is taken from the range of another node.
                     s64 section_ptr  = 0;
                     s64 section_size = (s64)1 << chunk_config.m_section_sizeshift;
-                    nsegment::allocate(&m_section_allocator, section_size, section_ptr);
+                    for (u32 n = 0; n < m_num_nodes; n++)
+                    {
+                        u32 const range_node = (node + n) % m_num_nodes;
+                        if (nsegment::allocate(&m_section_allocators[range_node], section_size, section_ptr))
+                        {
+                            section_ptr += (s64)range_node << m_node_range_shift;
+                            break;
+                        }
+                    }
 
                     section_t* section = ll_pop(m_section_free_list);
                     if (section == nullptr)
@@ -353,15 +766,16 @@ namespace ncore
                     section->clear();
                     section->m_section_address     = m_address_base + section_ptr;
                     u32 const section_chunk_count  = ((u32)1 << (chunk_config.m_section_sizeshift - chunk_config.m_sizeshift));
-                    section->m_chunk_array         = g_allocate_array<chunk_t*>(fsa, section_chunk_count);
+                    section->m_chunk_array         = g_allocate_array<chunk_t*>(m_fsa, section_chunk_count);
                     section->m_chunks_free_index   = 0;
                     section->m_chunks_cached_list  = nullptr;
                     section->m_chunks_free_bin0    = D_U64_MAX;
-                    section->m_chunks_free_bin1    = g_allocate_array<u64>(fsa, 8);
+                    section->m_chunks_free_bin1    = g_allocate_array<u64>(m_fsa, 8);
                     section->m_count_chunks_cached = 0;
                     section->m_count_chunks_used   = 0;
                     section->m_count_chunks_max    = section_chunk_count;
                     section->m_chunk_config        = chunk_config;
+                    section->m_lifetime            = (u16)lifetime;
 
                     // Allocate and initialize the binmap for tracking free chunks in this section.
                     // We are initializing the binmap with all elements being used, since
@@ -381,51 +795,66 @@ namespace ncore
                     for (u32 o = 0; o < node_count; o++)
                         m_section_map[node_index + o] = section_index;
 
+                    m_chunk_usage[chunk_config.m_chunkconfig_index].m_sections_used += 1;
                     return section;
                 }
 
-                void release_section(section_t* section, fsa_t* fsa)
+                void release_section(section_t* section)
                 {
                     ASSERT(section->m_count_chunks_used == 0);
 
                     // Remove this section from the active set for that chunk size
-                    ll_remove(m_section_active_array[section->m_chunk_config.m_chunkconfig_index], section);
-
-                    // TODO: Caching of sections
-                    // Maybe we should cache at least one section instance otherwise a single
-                    // alloc/dealloc can checkout and release a section every time?
+                    ll_remove(m_section_active_array[section_active_index(section)], section);
+                    m_chunk_usage[section->m_chunk_config.m_chunkconfig_index].m_sections_used -= 1;
+
+                    // Keep the section for reuse, sections beyond the retention count or time are destroyed
+                    u64 const       now           = nplatform::time_ms();
+                    sectioncache_t& section_cache = m_section_cache[section_list_index(section_node(section), section->m_chunk_config)];
+                    section->m_release_time       = now;
+                    ll_insert(section_cache.m_sections, section);
+                    section_cache.m_count += 1;
+                    evict_sections(section_cache, now);
+                }
 
-                    // Release all cached chunks in this section
-                    // Note: Is it possible to decommit the full section range in one call?
-                    while (section->m_count_chunks_cached > 0)
+                void evict_sections(sectioncache_t& section_cache, u64 now)
+                {
+                    while (section_cache.m_sections != nullptr)
                     {
-                        chunk_t*  chunk               = ll_pop(section->m_chunks_cached_list);
-                        u32 const section_chunk_index = chunk->m_section_chunk_index;
+                        section_t* const oldest  = section_cache.m_sections;
+                        bool const       expired = (now - oldest->m_release_time) >= m_config->m_section_cache_time_ms;
+                        if (section_cache.m_count <= m_config->m_section_cache_count && !expired)
+                            break;
+                        ll_remove(section_cache.m_sections, oldest);
+                        section_cache.m_count -= 1;
+                        destroy_section(oldest);
+                    }
+                }
 
-                        nbitvec12::clr(&section->m_chunks_free_bin0, section->m_chunks_free_bin1, section->m_count_chunks_max, section_chunk_index);
-                        v_alloc_decommit(chunk_to_address(chunk), ((u32)1 << m_page_size_shift) * chunk->m_physical_pages);
+                // Evicts from every section cache, so that expired sections are also released when no section is
+                // checked out or released (called from trim and the pressure poll), m_lock must be held.
+                void evict_all_sections(u64 now)
+                {
+                    for (u32 i = 0; i < m_num_nodes * m_config->m_num_chunkconfigs; i++)
+                        evict_sections(m_section_cache[i], now);
+                }
 
-                        {  // release resources allocated for this chunk
-                            nfsa::deallocate(fsa, chunk->m_elem_free_bin1);
-                            nfsa::deallocate(fsa, chunk->m_elem_tag_array);
-                            chunk->m_elem_tag_array = nullptr;
-                            chunk->m_elem_free_bin0 = D_U64_MAX;
-                            chunk->m_elem_free_bin1 = nullptr;
-                        }
-                        nfsa::deallocate(fsa, chunk);
-                        section->m_chunk_array[section_chunk_index] = nullptr;
-                        section->m_count_chunks_cached -= 1;
-                    }
+                void destroy_section(section_t* section)
+                {
+                    ASSERT(section->m_count_chunks_used == 0);
+
+                    // Release all cached chunks in this section
+                    release_cached_chunks(section, 0);
 
-                    g_deallocate_array(fsa, section->m_chunk_array);
+                    g_deallocate_array(m_fsa, section->m_chunk_array);
 
-                    nfsa::deallocate(fsa, section->m_chunks_free_bin1);
+                    nfsa::deallocate(m_fsa, section->m_chunks_free_bin1);
                     section->m_chunks_free_bin1 = nullptr;
 
                     // Deallocate the memory segment that was associated with this section
                     s64       section_ptr  = todistance(m_address_base, section->m_section_address);
                     const s64 section_size = 1 << section->m_chunk_config.m_section_sizeshift;
-                    nsegment::deallocate(&m_section_allocator, section_ptr, section_size);
+                    u32 const range_node   = section_node(section);
+                    nsegment::deallocate(&m_section_allocators[range_node], section_ptr - ((s64)range_node << m_node_range_shift), section_size);
 
                     // Clear our index from the section map array
                     u32 const node        = (u32)(section_ptr >> m_section_minsize_shift);
@@ -441,6 +870,149 @@ namespace ncore
                     ll_insert(m_section_free_list, section);
                 }
 
+                // Decommits the cached chunks of a section and gives them back to the section, with OS memory a run of
+                // adjacent cached chunks is decommitted with a single call. Other backends only get the committed pages
+                // of each chunk. Stops after a run once the committed pages are at or below 'target_pages' (0 releases
+                // all of them).
+                // Note: The caller holds m_lock
+                void release_cached_chunks(section_t* section, u32 target_pages)
+                {
+                    chunkcache_t& cache       = m_chunk_cache[section->m_chunk_config.m_chunkconfig_index];
+                    chunkusage_t& usage       = m_chunk_usage[section->m_chunk_config.m_chunkconfig_index];
+                    s8 const      chunk_shift = section->m_chunk_config.m_sizeshift;
+
+                    u32 c = 0;
+                    while (section->m_count_chunks_cached > 0 && c < section->m_chunks_free_index)
+                    {
+                        if (!s_is_cached(section->m_chunk_array[c]))
+                        {
+                            c++;
+                            continue;
+                        }
+
+                        u32 const run_begin = c;
+                        u32       run_pages = 0;  // Committed pages of the last chunk of the run
+                        while (c < section->m_chunks_free_index && s_is_cached(section->m_chunk_array[c]))
+                        {
+                            chunk_t* chunk = section->m_chunk_array[c];
+                            run_pages      = chunk->m_physical_pages;
+                            ll_remove(section->m_chunks_cached_list, chunk);
+                            nbitvec12::clr(&section->m_chunks_free_bin0, section->m_chunks_free_bin1, section->m_count_chunks_max, c);
+                            m_used_physical_pages -= chunk->m_physical_pages;
+                            usage.m_committed_pages -= chunk->m_physical_pages;
+                            cache.m_count -= 1;
+                            cache.m_pages -= chunk->m_physical_pages;
+
+                            // A backend other than the OS counts what is decommitted (and may check it)
+                            if (!m_os_memory && chunk->m_physical_pages > 0)
+                                m_backend->decommit(chunk_to_address(chunk), (u64)chunk->m_physical_pages << m_page_size_shift);
+
+                            // Note: The tag array and binmap of a cached chunk have already been released
+                            //       by release_chunk to the fsa of the allocator instance that owned it.
+                            ASSERT(chunk->m_elem_tag_array == nullptr);
+                            nfsa::deallocate(m_fsa, chunk);
+                            section->m_chunk_array[c] = nullptr;
+                            section->m_count_chunks_cached -= 1;
+                            c++;
+                        }
+
+                        // From the start of the first chunk up to the committed end of the last chunk, the uncommitted
+                        // tail pages of the chunks in between are part of the range, for the OS decommitting those is a no-op.
+                        if (m_os_memory)
+                        {
+                            u64 const run_size = ((u64)(c - 1 - run_begin) << chunk_shift) + ((u64)run_pages << m_page_size_shift);
+                            m_backend->decommit(toaddress(section->m_section_address, (u64)run_begin << chunk_shift), run_size);
+                        }
+
+                        if (target_pages > 0 && m_used_physical_pages <= target_pages)
+                            break;
+                    }
+                }
+
+                // A chunk that is owned by a section but not by an allocator instance
+                inline static bool s_is_cached(chunk_t const* chunk) { return chunk != nullptr && chunk->m_elem_free_bin1 == nullptr; }
+
+                // Gives committed memory that does not hold live elements back to the OS until at most 'target_bytes'
+                // are committed: first the empty sections that are kept for reuse, then the cached chunks of the
+                // sections in use. Expired empty sections are always released. Returns the number of bytes that were
+                // decommitted.
+                u64 trim(u64 target_bytes)
+                {
+                    scoped_spinlock_t lock(m_lock);
+
+                    u32 const target_pages = (u32)(target_bytes >> m_page_size_shift);
+                    u32 const begin_pages  = m_used_physical_pages;
+
+                    evict_all_sections(nplatform::time_ms());
+
+                    for (u32 i = 0; i < m_num_nodes * m_config->m_num_chunkconfigs && m_used_physical_pages > target_pages; i++)
+                    {
+                        sectioncache_t& section_cache = m_section_cache[i];
+                        while (section_cache.m_sections != nullptr && m_used_physical_pages > target_pages)
+                        {
+                            section_t* const oldest = section_cache.m_sections;
+                            ll_remove(section_cache.m_sections, oldest);
+                            section_cache.m_count -= 1;
+                            destroy_section(oldest);
+                        }
+                    }
+
+                    for (u32 s = 0; s < m_sections_free_index && m_used_physical_pages > target_pages; s++)
+                    {
+                        section_t* const section = &m_sections_array[s];
+                        if (section->m_chunk_array != nullptr && section->m_count_chunks_cached > 0)
+                            release_cached_chunks(section, target_pages);
+                    }
+
+                    return (u64)(begin_pages - m_used_physical_pages) << m_page_size_shift;
+                }
+
+                // A unique owner index for a heap that shares this superspace and is not an instance of a threaded context
+                u16 new_owner_index()
+                {
+                    scoped_spinlock_t lock(m_lock);
+                    if (m_next_owner_index < cFirstOwnerIndex)
+                        nplatform::fatal("too many child and region heaps on one superspace");
+                    return m_next_owner_index--;
+                }
+
+                // The owner index of a destroyed heap, only the most recent one is handed out again
+                void delete_owner_index(u16 owner_index)
+                {
+                    scoped_spinlock_t lock(m_lock);
+                    if (m_next_owner_index < cLastOwnerIndex && owner_index == (m_next_owner_index + 1))
+                        m_next_owner_index = owner_index;
+                }
+
+                // Asks the pressure source (at most once per interval) and trims to the target it returns, expired
+                // empty sections are released on every poll. The thread that moves the poll time forward with a CAS
+                // does the poll of this interval, the others return. The source is read under m_lock but called
+                // without it, trim takes the lock itself.
+                void poll_pressure()
+                {
+                    u64 const now  = nplatform::time_ms();
+                    u64       last = natomic::load_u64(&m_pressure_poll_time);
+                    if ((now - last) < natomic::load_u32(&m_pressure_interval_ms))
+                        return;
+                    if (!natomic::cas_u64(&m_pressure_poll_time, last, now))
+                        return;  // Another thread polls in this interval
+
+                    pressure_fn fn   = nullptr;
+                    void*       user = nullptr;
+                    {
+                        scoped_spinlock_t lock(m_lock);
+                        fn   = m_pressure_fn;
+                        user = m_pressure_user;
+                        evict_all_sections(now);
+                    }
+                    if (fn == nullptr)
+                        return;
+
+                    u64 target_bytes = 0;
+                    if (fn(user, target_bytes))
+                        trim(target_bytes);
+                }
+
                 void set_tag(void* ptr, u32 assoc)
                 {
                     ASSERT(ptr >= m_address_base && ptr < ((u8*)m_address_base + m_address_range));
@@ -448,9 +1020,11 @@ namespace ncore
                     ASSERT(chunk->m_bin_index < m_config->m_num_binconfigs);
                     binconfig_t const& bin = m_config->m_abinconfigs[chunk->m_bin_index];
 
-                    u32*        elem_tag_array       = chunk->m_elem_tag_array;
+                    u32* elem_tag_array = chunk->m_elem_tag_array;
+                    if (elem_tag_array == nullptr)
+                        return;  // Tagless
                     void* const chunk_address        = chunk_to_address(chunk);
-                    u32 const   chunk_item_index     = (u32)(todistance(chunk_address, ptr) / bin.m_alloc_size);
+                    u32 const   chunk_item_index     = bin.offset_to_index(todistance(chunk_address, ptr));
                     elem_tag_array[chunk_item_index] = assoc;
                 }
 
@@ -460,12 +1034,229 @@ namespace ncore
                     chunk_t const* chunk     = address_to_chunk(ptr);
                     s16 const      sbinindex = chunk->m_bin_index;
                     ASSERT(sbinindex < m_config->m_num_binconfigs);
+                    if (chunk->m_elem_tag_array == nullptr)
+                        return 0;  // Tagless
                     binconfig_t const& bin                 = m_config->m_abinconfigs[sbinindex];
                     void* const        chunk_address       = chunk_to_address(chunk);
-                    u32 const          chunk_element_index = (u32)(todistance(chunk_address, ptr) / bin.m_alloc_size);
+                    u32 const          chunk_element_index = bin.offset_to_index(todistance(chunk_address, ptr));
                     return chunk->m_elem_tag_array[chunk_element_index];
                 }
 
+                void get_stats(stats_t& stats)
+                {
+                    scoped_spinlock_t lock(m_lock);
+
+                    stats.m_page_size         = (u32)1 << m_page_size_shift;
+                    stats.m_committed_pages   = m_used_physical_pages;
+                    stats.m_num_chunkconfigs  = (u32)math::min((s32)m_config->m_num_chunkconfigs, (s32)stats_t::cMaxChunkConfigs);
+                    stats.m_aligned_count     = m_aligned_count;
+                    stats.m_aligned_pages     = m_aligned_pages;
+                    stats.m_aligned_waste     = m_aligned_size - ((u64)m_aligned_pages << m_page_size_shift);
+                    stats.m_internal_fsa_size = nfsa::get_used_size(m_fsa);
+                    for (u32 i = 0; i < stats.m_num_chunkconfigs; i++)
+                    {
+                        chunkconfig_stats_t& cs = stats.m_chunkconfigs[i];
+                        cs.m_chunk_size         = (u64)1 << m_config->m_achunkconfigs[i].m_sizeshift;
+                        cs.m_chunks_used        = m_chunk_usage[i].m_chunks_used;
+                        cs.m_chunks_cached      = m_chunk_cache[i].m_count;
+                        cs.m_chunks_cached_max  = m_chunk_cache[i].m_max;
+                        cs.m_cached_pages       = m_chunk_cache[i].m_pages;
+                        cs.m_committed_pages    = m_chunk_usage[i].m_committed_pages;
+                        cs.m_sections_used      = m_chunk_usage[i].m_sections_used;
+                        cs.m_sections_cached    = 0;
+                        for (u32 n = 0; n < m_num_nodes; n++)
+                            cs.m_sections_cached += m_section_cache[(n * m_config->m_num_chunkconfigs) + i].m_count;
+                    }
+                }
+
+                // Walks all sections and their chunks, the per bin and per section numbers are accumulated in 'report'
+                void analyze(fragmentation_t& report)
+                {
+                    scoped_spinlock_t lock(m_lock);
+
+                    report.m_page_size      = (u32)1 << m_page_size_shift;
+                    report.m_num_binconfigs = (u32)math::min((s32)m_config->m_num_binconfigs, (s32)fragmentation_t::cMaxBinConfigs);
+                    for (u32 b = 0; b < report.m_num_binconfigs; b++)
+                        report.m_bins[b].m_alloc_size = m_config->m_abinconfigs[b].m_alloc_size;
+
+                    for (u32 s = 0; s < m_sections_free_index; s++)
+                    {
+                        section_t const* section = &m_sections_array[s];
+                        if (section->m_chunk_array == nullptr)
+                            continue;  // On the free list
+
+                        section_fragmentation_t sf;
+                        nmem::memset(&sf, 0, sizeof(sf));
+                        sf.m_address_offset = todistance(m_address_base, section->m_section_address);
+                        sf.m_size           = (u64)1 << section->m_chunk_config.m_section_sizeshift;
+                        sf.m_chunk_size     = (u64)1 << section->m_chunk_config.m_sizeshift;
+                        sf.m_chunks_max     = section->m_count_chunks_max;
+
+                        for (u32 c = 0; c < section->m_chunks_free_index; c++)
+                        {
+                            chunk_t const* chunk = section->m_chunk_array[c];
+                            if (chunk == nullptr)
+                                continue;
+
+                            u64 const committed = (u64)chunk->m_physical_pages << m_page_size_shift;
+                            sf.m_committed_pages += chunk->m_physical_pages;
+                            if (chunk->m_elem_free_bin1 == nullptr)
+                            {
+                                // Cached, its tag array and binmap have been released
+                                sf.m_chunks_cached += 1;
+                                sf.m_cached_pages += chunk->m_physical_pages;
+                                report.m_cached_bytes += committed;
+                                continue;
+                            }
+
+                            sf.m_chunks_used += 1;
+                            binconfig_t const& bin       = m_config->m_abinconfigs[chunk->m_bin_index];
+                            u64 const          elem_size = s_is_aligned_bin(m_config, chunk->m_bin_index) ? committed : bin.m_alloc_size;
+                            u64 const          used      = chunk->m_elem_used_count;
+                            u64 const          available = math::min((u64)bin.m_max_alloc_count, committed / elem_size);  // Pages are committed lazily
+                            u64 const          unused    = available > used ? available - used : 0;
+                            report.m_used_bytes += used * elem_size;
+                            report.m_free_element_bytes += unused * elem_size;
+
+                            u64 recorded = 0, requested = 0;
+                            if (chunk->m_elem_size_array != nullptr)
+                            {
+                                for (u32 e = 0; e < chunk->m_elem_free_index; e++)
+                                {
+                                    if (nbitvec12::is_set(&chunk->m_elem_free_bin0, chunk->m_elem_free_bin1, bin.m_max_alloc_count, e))
+                                    {
+                                        recorded += 1;
+                                        requested += chunk->m_elem_size_array[e];
+                                    }
+                                }
+                                report.m_recorded_bytes += recorded * elem_size;
+                                report.m_requested_bytes += requested;
+                            }
+
+                            if (chunk->m_bin_index < report.m_num_binconfigs)
+                            {
+                                bin_fragmentation_t& bf = report.m_bins[chunk->m_bin_index];
+                                bf.m_chunks += 1;
+                                bf.m_elements_used += used;
+                                bf.m_elements_free += unused;
+                                bf.m_elements_recorded += recorded;
+                                bf.m_requested_bytes += requested;
+                                bf.m_committed_bytes += committed;
+                            }
+                        }
+
+                        sf.m_unused_address = sf.m_size - ((u64)sf.m_committed_pages << m_page_size_shift);
+                        report.m_committed_bytes += (u64)sf.m_committed_pages << m_page_size_shift;
+                        report.m_unused_address += sf.m_unused_address;
+                        if (report.m_num_sections < fragmentation_t::cMaxSections)
+                            report.m_sections[report.m_num_sections] = sf;
+                        report.m_num_sections += 1;
+                    }
+                }
+
+                // Changes the protection of every committed page, used and cached chunks, pages that are committed
+                // later get the same protection (see commit_chunk_pages)
+                void protect(u8 protect)
+                {
+                    scoped_spinlock_t lock(m_lock);
+                    m_region_protect = protect;
+                    if (!m_os_memory)
+                        return;
+
+                    for (u32 s = 0; s < m_sections_free_index; s++)
+                    {
+                        section_t const* section = &m_sections_array[s];
+                        if (section->m_chunk_array == nullptr)
+                            continue;  // On the free list
+                        for (u32 c = 0; c < section->m_chunks_free_index; c++)
+                        {
+                            chunk_t const* chunk = section->m_chunk_array[c];
+                            if (chunk != nullptr && chunk->m_physical_pages > 0)
+                                nplatform::protect_pages(chunk_to_address(chunk), (u64)chunk->m_physical_pages << m_page_size_shift, protect == region_t::cProtectReadOnly);
+                        }
+                    }
+                }
+
+                struct visit_item_t
+                {
+                    void* m_ptr;
+                    u32   m_size;
+                    u32   m_tag;
+                };
+
+                enum
+                {
+                    cVisitBatch = 64,
+                };
+
+                // Calls 'fn' for every live element of every used chunk, returns false when 'fn' stopped the walk.
+                // The elements are collected in batches under the lock and 'fn' is called without holding it, the
+                // walk continues at the same section, chunk and element index after every batch.
+                bool visit(visit_fn fn, void* user)
+                {
+                    visit_item_t items[cVisitBatch];
+                    u32          s = 0, c = 0, e = 0;
+                    u32          count = cVisitBatch;
+                    while (count == cVisitBatch)
+                    {
+                        count = 0;
+                        {
+                            scoped_spinlock_t lock(m_lock);
+                            for (; s < m_sections_free_index; s++, c = 0)
+                            {
+                                section_t const* section = &m_sections_array[s];
+                                if (section->m_chunk_array == nullptr)
+                                    continue;  // On the free list
+                                for (; c < section->m_chunks_free_index; c++, e = 0)
+                                {
+                                    chunk_t const* chunk = section->m_chunk_array[c];
+                                    if (chunk == nullptr || chunk->m_elem_free_bin1 == nullptr)
+                                        continue;  // Free or cached
+                                    e = visit_chunk(chunk, e, items, count);
+                                    if (count == cVisitBatch)
+                                        break;
+                                }
+                                if (count == cVisitBatch)
+                                    break;
+                            }
+                        }
+
+                        for (u32 i = 0; i < count; ++i)
+                        {
+                            if (!fn(items[i].m_ptr, items[i].m_size, items[i].m_tag, user))
+                                return false;
+                        }
+                    }
+                    return true;
+                }
+
+                // Appends the live elements of 'chunk', starting at element 'elem', to 'items' until the batch is full.
+                // Returns the element to continue with, m_elem_free_index when the chunk is done.
+                // Elements at or beyond m_elem_free_index have never been handed out. When the used count equals the
+                // free index nothing below it was freed and the binmap does not need to be consulted at all, otherwise
+                // every element below the free index is checked with the binmap.
+                u32 visit_chunk(chunk_t const* chunk, u32 elem, visit_item_t* items, u32& count) const
+                {
+                    binconfig_t const& bin       = m_config->m_abinconfigs[chunk->m_bin_index];
+                    byte* const        address   = (byte*)chunk_to_address(chunk);
+                    u32 const          elem_size = s_is_aligned_bin(m_config, chunk->m_bin_index) ? (chunk->m_physical_pages << m_page_size_shift) : bin.m_alloc_size;
+                    u32 const          end       = chunk->m_elem_free_index;
+                    bool const         dense     = chunk->m_elem_used_count == end;
+
+                    for (; elem < end; elem++)
+                    {
+                        if (!dense && !nbitvec12::is_set(&chunk->m_elem_free_bin0, chunk->m_elem_free_bin1, bin.m_max_alloc_count, elem))
+                            continue;
+                        if (count == cVisitBatch)
+                            return elem;
+                        items[count].m_ptr  = address + ((u64)elem * bin.m_alloc_size);
+                        items[count].m_size = elem_size;
+                        items[count].m_tag  = (chunk->m_elem_tag_array != nullptr) ? chunk->m_elem_tag_array[elem] : 0;
+                        count += 1;
+                    }
+                    return end;
+                }
+
                 inline chunk_t* address_to_chunk(void* ptr) const
                 {
                     u32 const mapped_index = (u32)((todistance(m_address_base, ptr) >> m_section_minsize_shift) & 0xFFFFFFFF);
@@ -484,7 +1275,8 @@ namespace ncore
 
                 inline void* chunk_to_address(chunk_t const* chunk) const
                 {
-                    s8 const  chunk_sizeshift = m_config->m_abinconfigs[chunk->m_bin_index].m_chunk_config.m_sizeshift;
+                    // Note: Using the chunk config of the section, a released or cached chunk has no valid bin index
+                    s8 const  chunk_sizeshift = chunk->m_section->m_chunk_config.m_sizeshift;
                     u64 const chunk_offset    = ((u64)chunk->m_section_chunk_index << chunk_sizeshift);
                     return toaddress(chunk->m_section->m_section_address, chunk_offset);
                 }
@@ -494,54 +1286,188 @@ namespace ncore
         class superalloc_t : public vmalloc_t
         {
         public:
-            config_t const*        m_config;
-            arena_t*               m_internal_heap;
-            fsa_t*                 m_internal_fsa;
-            nsuperspace::alloc_t*  m_superspace;
-            nsuperspace::chunk_t** m_active_chunk_list_per_bin;
-            alloc_t*               m_main_allocator;
+            config_t const*                m_config;
+            arena_t*                       m_internal_heap;
+            fsa_t*                         m_internal_fsa;
+            nsuperspace::alloc_t*          m_superspace;
+            nsuperspace::chunk_t**         m_active_chunk_list_per_bin;  // cActiveBuckets lists per lifetime and bin, see active_list
+            nsuperspace::chunk_t*          m_full_chunk_list;            // Full chunks (including aligned chunks), every owned chunk is in a list
+            bin_stats_t*                   m_bin_stats;                  // Usage counters per bin, only touched by this instance
+            alloc_t*                       m_main_allocator;
+            superalloc_t*                  m_parent;                     // The heap whose superspace this child heap uses (nullptr when not a child)
+            superalloc_t**                 m_instances;                  // Instances sharing the superspace, indexed by instance index (nullptr when not shared)
+            nsuperspace::chunk_t* volatile m_deferred_chunks;            // Owned chunks that have elements freed by other instances
+            u16                            m_instance_index;             // Index of this instance in m_instances, the owner index of its chunks
+            u16                            m_max_instances;              // The number of entries in m_instances
+            bool                           m_owns_superspace;            // False when the superspace is shared (threaded context, child heap, region)
 
             superalloc_t(alloc_t* main_allocator)
                 : m_config(nullptr)
+                , m_internal_heap(nullptr)
+                , m_internal_fsa(nullptr)
                 , m_superspace(nullptr)
                 , m_active_chunk_list_per_bin(nullptr)
+                , m_full_chunk_list(nullptr)
+                , m_bin_stats(nullptr)
                 , m_main_allocator(main_allocator)
+                , m_parent(nullptr)
+                , m_instances(nullptr)
+                , m_deferred_chunks(nullptr)
+                , m_instance_index(0)
+                , m_max_instances(0)
+                , m_owns_superspace(false)
             {
             }
 
             DCORE_CLASS_PLACEMENT_NEW_DELETE
 
-            void initialize(config_t const* config);
+            void initialize(config_t const* config, bool tagless, numa_t const* numa, backend_t* backend);
+            void initialize(config_t const* config, nsuperspace::alloc_t* superspace, superalloc_t** instances, u16 max_instances, u16 instance_index);
+            void initialize(superalloc_t* parent);
             void deinitialize();
 
+            void collect_deferred();
+            void release_all_chunks();
+
             virtual void* v_allocate(u32 size, u32 alignment);
+            virtual void* v_reallocate(void* ptr, u32 new_size, u32 alignment) final;
+            virtual void* v_allocate_bin(u8 bin_index, u32 size, u32 alignment) final;
             virtual void  v_deallocate(void* ptr);
-            virtual void  v_release() {}
+            virtual void  v_release() final;
 
             virtual u32  v_get_size(void* ptr) const final;
             virtual void v_set_tag(void* ptr, u32 assoc) final;
             virtual u32  v_get_tag(void* ptr) const final;
+            virtual void v_get_stats(stats_t& stats) const final;
+            virtual u32  v_allocate_n(u32 size, u32 alignment, void** out, u32 count) final;
+            virtual void v_deallocate_n(void** ptrs, u32 count) final;
+            virtual void v_record_sizes(bool enable) final;
+            virtual void v_analyze(fragmentation_t& report) const final;
+            virtual void v_visit(visit_fn fn, void* user) const final;
+            virtual u64  v_trim(u64 target_bytes) final;
+            virtual void v_set_pressure_source(pressure_fn fn, void* user, u32 interval_ms) final;
+
+            virtual void* v_allocate_hinted(u32 size, u32 alignment, lifetime_t hint) final;
+
+        private:
+            void  initialize_instance(config_t const* config);
+            void* allocate_from_bin(u32 alloc_size, u8 bin_index, lifetime_t lifetime);
+            u8    alloc_to_bin(u32 alloc_size, u32 alignment) const;
+            u8    alloc_to_aligned_bin(u32 alloc_size, u32 alignment) const;
+            void* allocate_aligned(u32 alloc_size, u8 bin_index, lifetime_t lifetime);
+            bool  release_element(nsuperspace::chunk_t* chunk, binconfig_t const& bin, void* ptr);
+            void  release_elements(nsuperspace::chunk_t* chunk, u32 count);
+            void  deallocate_deferred(nsuperspace::chunk_t* chunk, void* ptr);
+
+            superalloc_t* foreign_owner(nsuperspace::chunk_t const* chunk) const;
+
+            // The active (not full) chunks of a bin are kept in occupancy buckets: nearly full (>= 3/4), half (>= 1/4)
+            // and nearly empty. Allocation takes the fullest chunk, so that nearly empty chunks can drain and be
+            // released. The bucket of a chunk follows from its element count, it only moves when crossing a boundary.
+            enum
+            {
+                cActiveBuckets = 3,
+            };
+
+            inline static u32 s_bucket(binconfig_t const& bin, u32 used_count)
+            {
+                u32 const quarters = (used_count << 2);
+                return (quarters >= (bin.m_max_alloc_count * 3)) ? 0 : ((quarters >= bin.m_max_alloc_count) ? 1 : 2);
+            }
+
+            inline nsuperspace::chunk_t*& active_list(u32 lifetime, u8 bin_index, u32 bucket) { return m_active_chunk_list_per_bin[(((lifetime * m_config->m_num_binconfigs) + bin_index) * cActiveBuckets) + bucket]; }
+
+            inline nsuperspace::chunk_t* active_chunk(u32 lifetime, u8 bin_index) const
+            {
+                nsuperspace::chunk_t* const* lists = &m_active_chunk_list_per_bin[((lifetime * m_config->m_num_binconfigs) + bin_index) * cActiveBuckets];
+                return (lists[0] != nullptr) ? lists[0] : ((lists[1] != nullptr) ? lists[1] : lists[2]);
+            }
+
+            // Moves an active chunk to the bucket of its current element count
+            inline void update_bucket(nsuperspace::chunk_t* chunk, binconfig_t const& bin, u32 old_used_count)
+            {
+                u32 const old_bucket = s_bucket(bin, old_used_count);
+                u32 const new_bucket = s_bucket(bin, chunk->m_elem_used_count);
+                if (old_bucket != new_bucket)
+                {
+                    ll_remove(active_list(chunk->m_lifetime, (u8)chunk->m_bin_index, old_bucket), chunk);
+                    ll_insert(active_list(chunk->m_lifetime, (u8)chunk->m_bin_index, new_bucket), chunk);
+                }
+            }
         };
 
-        void superalloc_t::initialize(config_t const* config)
+        void superalloc_t::initialize_instance(config_t const* config)
         {
             m_config = config;
 
             m_internal_heap = narena::new_arena(config->m_internal_heap_address_range, config->m_internal_heap_pre_size);
             m_internal_fsa  = nfsa::new_fsa(config->m_internal_fsa_block_count);
 
+            m_active_chunk_list_per_bin = g_allocate_array_and_clear<nsuperspace::chunk_t*>(m_internal_heap, config->m_num_binconfigs * cLifetimeCount * cActiveBuckets);
+            m_bin_stats                 = g_allocate_array_and_clear<bin_stats_t>(m_internal_heap, config->m_num_binconfigs);
+            for (s32 i = 0; i < config->m_num_binconfigs * cLifetimeCount * cActiveBuckets; i++)
+                m_active_chunk_list_per_bin[i] = nullptr;
+            for (s16 i = 0; i < config->m_num_binconfigs; i++)
+            {
+                m_bin_stats[i].m_alloc_size    = config->m_abinconfigs[i].m_alloc_size;
+                m_bin_stats[i].m_elements_used = 0;
+                m_bin_stats[i].m_chunks_active = 0;
+                m_bin_stats[i].m_chunks_full   = 0;
+            }
+
+            m_full_chunk_list = nullptr;
+            m_deferred_chunks = nullptr;
+        }
+
+        void superalloc_t::initialize(config_t const* config, bool tagless, numa_t const* numa, backend_t* backend)
+        {
+            initialize_instance(config);
+
             m_superspace = g_allocate<nsuperspace::alloc_t>(m_internal_heap);
-            m_superspace->initialize(config, m_internal_heap, m_internal_fsa);
+            m_superspace->initialize(config, m_internal_heap, m_internal_fsa, tagless, numa, nullptr, nullptr, backend);
 
-            m_active_chunk_list_per_bin = g_allocate_array_and_clear<nsuperspace::chunk_t*>(m_internal_heap, config->m_num_binconfigs);
-            for (s16 i = 0; i < config->m_num_binconfigs; i++)
-                m_active_chunk_list_per_bin[i] = nullptr;
+            m_instances       = nullptr;
+            m_instance_index  = 0;
+            m_max_instances   = 0;
+            m_owns_superspace = true;
+        }
+
+        // An instance of a threaded context ('instances' is the array of the context, 'instance_index' the thread
+        // index) or a region heap ('instances' is nullptr, 'instance_index' from new_owner_index)
+        void superalloc_t::initialize(config_t const* config, nsuperspace::alloc_t* superspace, superalloc_t** instances, u16 max_instances, u16 instance_index)
+        {
+            initialize_instance(config);
+
+            m_superspace     = superspace;
+            m_instances      = instances;
+            m_instance_index = instance_index;
+            m_max_instances  = max_instances;
+        }
+
+        // A child heap, it takes its chunks from the superspace of 'parent' under an owner index of its own
+        void superalloc_t::initialize(superalloc_t* parent)
+        {
+            initialize_instance(parent->m_config);
+
+            m_superspace     = parent->m_superspace;
+            m_parent         = parent;
+            m_instances      = nullptr;
+            m_instance_index = m_superspace->new_owner_index();
+            m_max_instances  = 0;
         }
 
         void superalloc_t::deinitialize()
         {
-            m_superspace->deinitialize(m_internal_heap);
-            g_deallocate(m_internal_heap, m_superspace);
+            // A shared superspace is owned (and deinitialized) by whoever created it
+            if (m_owns_superspace)
+            {
+                m_superspace->deinitialize(m_internal_heap);
+                g_deallocate(m_internal_heap, m_superspace);
+            }
+            else if (m_instances == nullptr)
+            {
+                m_superspace->delete_owner_index(m_instance_index);
+            }
 
             nfsa::destroy(m_internal_fsa);
             narena::destroy(m_internal_heap);
@@ -549,22 +1475,73 @@ namespace ncore
             m_config         = nullptr;
             m_superspace     = nullptr;
             m_main_allocator = nullptr;
+            m_parent         = nullptr;
+            m_instances      = nullptr;
         }
 
-        void* superalloc_t::v_allocate(u32 alloc_size, u32 alignment)
+        // Hands every chunk of this instance back to the superspace in one pass over the chunk lists, the
+        // allocations that are still live are discarded instead of being freed one by one.
+        void superalloc_t::release_all_chunks()
         {
-            alloc_size                   = math::alignUp(alloc_size, alignment);
-            const u8           bin_index = m_config->size2bin(alloc_size);
-            binconfig_t const& bin       = m_config->m_abinconfigs[bin_index];
+            ASSERT(m_deferred_chunks == nullptr);
+            m_superspace->release_chunks(m_active_chunk_list_per_bin, m_config->m_num_binconfigs * cLifetimeCount * cActiveBuckets, m_internal_fsa);
+            m_superspace->release_chunks(&m_full_chunk_list, 1, m_internal_fsa);
+            for (s16 i = 0; i < m_config->m_num_binconfigs; i++)
+            {
+                m_bin_stats[i].m_elements_used = 0;
+                m_bin_stats[i].m_chunks_active = 0;
+                m_bin_stats[i].m_chunks_full   = 0;
+            }
+        }
+
+        void* superalloc_t::v_allocate(u32 alloc_size, u32 alignment) { return v_allocate_hinted(alloc_size, alignment, cLifetimeNormal); }
+
+        void* superalloc_t::v_allocate_hinted(u32 alloc_size, u32 alignment, lifetime_t hint)
+        {
+            ASSERT(hint < cLifetimeCount);
+
+            // Other instances might have freed elements that belong to chunks we own, reclaim them
+            if (m_instances != nullptr && natomic::load_ptr((void* volatile*)&m_deferred_chunks) != nullptr)
+                collect_deferred();
+
+            const u8 bin_index = alloc_to_bin(alloc_size, alignment);
+            if (bin_index >= m_config->m_alignedbin_index)
+                return (bin_index < m_config->m_num_binconfigs) ? allocate_aligned(alloc_size, bin_index, hint) : nullptr;
+            return allocate_from_bin(alloc_size, bin_index, hint);
+        }
+
+        void* superalloc_t::v_allocate_bin(u8 bin_index, u32 alloc_size, u32 alignment)
+        {
+            // The bin was resolved at compile time by nconfig25p::size2bin, it is only used as is when the config was
+            // validated to agree with that mapping, otherwise the size is mapped to a bin of our config
+            if (!m_config->m_static_size2bin || bin_index >= m_config->m_alignedbin_index || s_elem_alignment(m_config->m_abinconfigs[bin_index]) < alignment)
+                return v_allocate(alloc_size, alignment);
+            ASSERT(alloc_size <= m_config->m_abinconfigs[bin_index].m_alloc_size);
+
+            if (m_instances != nullptr && natomic::load_ptr((void* volatile*)&m_deferred_chunks) != nullptr)
+                collect_deferred();
 
-            nsuperspace::chunk_t* chunk = m_active_chunk_list_per_bin[bin_index];
+            return allocate_from_bin(alloc_size, bin_index, cLifetimeNormal);
+        }
+
+        void* superalloc_t::allocate_from_bin(u32 alloc_size, u8 bin_index, lifetime_t lifetime)
+        {
+            binconfig_t const& bin = m_config->m_abinconfigs[bin_index];
+
+            bin_stats_t&          bin_stats = m_bin_stats[bin_index];
+            nsuperspace::chunk_t* chunk     = active_chunk(lifetime, bin_index);
             if (chunk == nullptr)
             {
-                chunk = m_superspace->checkout_chunk(bin_index, m_internal_fsa);
-                ll_insert(m_active_chunk_list_per_bin[bin_index], chunk);
+                chunk = m_superspace->checkout_chunk(bin_index, lifetime, m_internal_fsa);
+                if (chunk == nullptr)
+                    return nullptr;
+                chunk->m_owner_index = m_instance_index;
+                ll_insert(active_list(lifetime, bin_index, s_bucket(bin, 0)), chunk);
+                bin_stats.m_chunks_active += 1;
             }
 
             ASSERT(chunk->m_bin_index == bin_index);
+            ASSERT(chunk->m_owner_index == m_instance_index);
             ASSERT(alloc_size <= bin.m_alloc_size);
 
             // If we have elements in the binmap, we can use it to get a free element.
@@ -574,17 +1551,38 @@ namespace ncore
             {
                 elem_index = chunk->m_elem_free_index++;
                 nbitvec12::tick_lazy(&chunk->m_elem_free_bin0, chunk->m_elem_free_bin1, bin.m_max_alloc_count, elem_index);
+
+                // A new high-water mark, the element might be (partly) on pages that are not committed yet
+                if ((((u64)elem_index + 1) * bin.m_alloc_size) > ((u64)chunk->m_physical_pages << m_superspace->m_page_size_shift))
+                {
+                    if (!m_superspace->grow_chunk(chunk, bin, (u32)elem_index + 1))
+                    {
+                        chunk->m_elem_free_index -= 1;  // Out of memory, the element is not taken
+                        return nullptr;
+                    }
+                }
             }
             ASSERT(elem_index < (s32)bin.m_max_alloc_count);
 
             // Initialize the tag value for this element
-            chunk->m_elem_tag_array[elem_index] = 0;
+            if (chunk->m_elem_tag_array != nullptr)
+                chunk->m_elem_tag_array[elem_index] = 0;
+            if (chunk->m_elem_size_array != nullptr)
+                chunk->m_elem_size_array[elem_index] = alloc_size;
 
             chunk->m_elem_used_count += 1;
+            bin_stats.m_elements_used += 1;
             if (chunk->m_elem_used_count >= bin.m_max_alloc_count)
             {
-                // Chunk is full, so remove it from the list of active chunks
-                ll_remove(m_active_chunk_list_per_bin[bin_index], chunk);
+                // Chunk is full, so move it from the list of active chunks to the list of full chunks
+                ll_remove(active_list(lifetime, bin_index, s_bucket(bin, chunk->m_elem_used_count - 1)), chunk);
+                ll_insert(m_full_chunk_list, chunk);
+                bin_stats.m_chunks_active -= 1;
+                bin_stats.m_chunks_full += 1;
+            }
+            else
+            {
+                update_bucket(chunk, bin, chunk->m_elem_used_count - 1);
             }
 
             void* chunk_address = m_superspace->chunk_to_address(chunk);
@@ -593,6 +1591,302 @@ namespace ncore
             return item_ptr;
         }
 
+        // An element is aligned to the largest power-of-two that divides the element size, since chunks are aligned
+        // to their size (see nsuperspace::alloc_t::initialize). Alignments up to the page size are served by walking
+        // up the bins until the element size guarantees the alignment. Larger alignments, when the bin does not
+        // already provide them, go to an aligned bin, a chunk with a single element of which only the pages that
+        // are needed are committed. This costs address space instead of physical memory, see stats_t::m_aligned_waste.
+        u8 superalloc_t::alloc_to_bin(u32 alloc_size, u32 alignment) const
+        {
+            ASSERT(alignment == 0 || math::ispo2(alignment));
+
+            u8 bin_index = m_config->size2bin_fast(alloc_size);
+            if (alignment <= ((u32)1 << m_superspace->m_page_size_shift))
+            {
+                while (s_elem_alignment(m_config->m_abinconfigs[bin_index]) < alignment)
+                    bin_index += 1;
+                ASSERT(bin_index < m_config->m_alignedbin_index);
+                return bin_index;
+            }
+
+            if (s_elem_alignment(m_config->m_abinconfigs[bin_index]) >= alignment)
+                return bin_index;
+
+            return alloc_to_aligned_bin(alloc_size, alignment);
+        }
+
+        // The aligned bin of the smallest chunk that can hold the allocation and is aligned to the requested alignment
+        u8 superalloc_t::alloc_to_aligned_bin(u32 alloc_size, u32 alignment) const
+        {
+            for (s16 c = 0; c < m_config->m_num_chunkconfigs; ++c)
+            {
+                u64 const chunk_size = (u64)1 << m_config->m_achunkconfigs[c].m_sizeshift;
+                if (chunk_size >= alignment && chunk_size >= alloc_size)
+                    return (u8)(m_config->m_alignedbin_index + c);
+            }
+            ASSERT(false);  // Alignment or size is larger than the largest chunk
+            return (u8)m_config->m_num_binconfigs;
+        }
+
+        void* superalloc_t::allocate_aligned(u32 alloc_size, u8 bin_index, lifetime_t lifetime)
+        {
+            binconfig_t const& bin        = m_config->m_abinconfigs[bin_index];
+            s8 const           page_shift = m_superspace->m_page_size_shift;
+            u32 const          pages      = math::max((u32)(((u64)alloc_size + ((u64)1 << page_shift) - 1) >> page_shift), (u32)1);
+
+            nsuperspace::chunk_t* chunk = m_superspace->checkout_chunk(bin_index, lifetime, m_internal_fsa, pages, pages);
+            if (chunk == nullptr)
+                return nullptr;
+            chunk->m_owner_index = m_instance_index;
+
+            // The chunk is full with this single element, so it never enters the list of active chunks
+            ll_insert(m_full_chunk_list, chunk);
+            s32 const elem_index = chunk->m_elem_free_index++;
+            nbitvec12::tick_lazy(&chunk->m_elem_free_bin0, chunk->m_elem_free_bin1, bin.m_max_alloc_count, elem_index);
+            ASSERT(elem_index == 0 && bin.m_max_alloc_count == 1);
+            if (chunk->m_elem_tag_array != nullptr)
+                chunk->m_elem_tag_array[elem_index] = 0;
+            if (chunk->m_elem_size_array != nullptr)
+                chunk->m_elem_size_array[elem_index] = alloc_size;
+            chunk->m_elem_used_count = 1;
+
+            bin_stats_t& bin_stats = m_bin_stats[bin_index];
+            bin_stats.m_elements_used += 1;
+            bin_stats.m_chunks_full += 1;
+
+            return m_superspace->chunk_to_address(chunk);
+        }
+
+        void* superalloc_t::v_reallocate(void* ptr, u32 new_size, u32 alignment)
+        {
+            if (ptr == nullptr)
+                return v_allocate(new_size, alignment);
+            if (new_size == 0)
+            {
+                v_deallocate(ptr);
+                return nullptr;
+            }
+
+            ASSERT(ptr >= m_superspace->m_address_base && ptr < ((u8*)m_superspace->m_address_base + m_superspace->m_address_range));
+            nsuperspace::chunk_t* chunk      = m_superspace->address_to_chunk(ptr);
+            s8 const              page_shift = m_superspace->m_page_size_shift;
+            u32                   old_size   = 0;
+            if (chunk->m_bin_index >= m_config->m_alignedbin_index)
+            {
+                // The element owns the chunk, it grows and shrinks in place by (de)committing the tail pages
+                old_size             = chunk->m_physical_pages << page_shift;
+                u64 const chunk_size = (u64)1 << chunk->m_section->m_chunk_config.m_sizeshift;
+                if (new_size <= chunk_size && s_is_aligned(ptr, alignment))
+                {
+                    u32 const pages = (u32)(((u64)new_size + ((u64)1 << page_shift) - 1) >> page_shift);
+                    if (!m_superspace->resize_chunk(chunk, pages))
+                        return nullptr;  // Out of memory, the allocation is left as it is
+                    if (chunk->m_elem_size_array != nullptr)
+                        chunk->m_elem_size_array[0] = new_size;
+                    return ptr;
+                }
+            }
+            else
+            {
+                // Stay in place as long as the size fits the bin and does not waste more than half of it
+                binconfig_t const& bin = m_config->m_abinconfigs[chunk->m_bin_index];
+                old_size               = bin.m_alloc_size;
+                if (new_size <= bin.m_alloc_size && new_size >= (bin.m_alloc_size >> 1) && s_is_aligned(ptr, alignment))
+                {
+                    if (chunk->m_elem_size_array != nullptr)
+                        chunk->m_elem_size_array[bin.offset_to_index(todistance(m_superspace->chunk_to_address(chunk), ptr))] = new_size;
+                    return ptr;
+                }
+            }
+
+            // Moving copies the contents, a backend other than the OS might not have memory the CPU can access
+            if (!m_superspace->m_os_memory)
+                return nullptr;
+
+            // We have to move, a growing allocation of at least the smallest chunk size gets a chunk of its own,
+            // so that the next time it grows it can do so in place. The lifetime hint moves along.
+            void*            new_ptr        = nullptr;
+            lifetime_t const lifetime       = (lifetime_t)chunk->m_lifetime;
+            u64 const        min_chunk_size = (u64)1 << m_config->m_achunkconfigs[0].m_sizeshift;
+            if (new_size > old_size && new_size >= min_chunk_size)
+            {
+                u8 const bin_index = alloc_to_aligned_bin(new_size, alignment);
+                if (bin_index < m_config->m_num_binconfigs)
+                    new_ptr = allocate_aligned(new_size, bin_index, lifetime);
+            }
+            else
+            {
+                new_ptr = v_allocate_hinted(new_size, alignment, lifetime);
+            }
+            if (new_ptr == nullptr)
+                return nullptr;
+
+            nmem::memcpy(new_ptr, ptr, math::min(old_size, new_size));
+            m_superspace->set_tag(new_ptr, m_superspace->get_tag(ptr));
+            v_deallocate(ptr);
+            return new_ptr;
+        }
+
+        u32 superalloc_t::v_allocate_n(u32 alloc_size, u32 alignment, void** out, u32 count)
+        {
+            if (m_instances != nullptr && natomic::load_ptr((void* volatile*)&m_deferred_chunks) != nullptr)
+                collect_deferred();
+
+            // The bin, and per chunk the chunk address, are resolved once for the whole batch
+            const u8 bin_index = alloc_to_bin(alloc_size, alignment);
+            if (bin_index >= m_config->m_alignedbin_index)
+            {
+                // Every element has a chunk of its own
+                u32 n = 0;
+                while (n < count && bin_index < m_config->m_num_binconfigs)
+                {
+                    void* const ptr = allocate_aligned(alloc_size, bin_index, cLifetimeNormal);
+                    if (ptr == nullptr)
+                        break;
+                    out[n++] = ptr;
+                }
+                return n;
+            }
+            binconfig_t const& bin       = m_config->m_abinconfigs[bin_index];
+            bin_stats_t&       bin_stats = m_bin_stats[bin_index];
+            ASSERT(alloc_size <= bin.m_alloc_size);
+
+            u32 n = 0;
+            while (n < count)
+            {
+                nsuperspace::chunk_t* chunk = active_chunk(cLifetimeNormal, bin_index);
+                if (chunk == nullptr)
+                {
+                    chunk = m_superspace->checkout_chunk(bin_index, cLifetimeNormal, m_internal_fsa);
+                    if (chunk == nullptr)
+                        return n;
+                    chunk->m_owner_index = m_instance_index;
+                    ll_insert(active_list(cLifetimeNormal, bin_index, s_bucket(bin, 0)), chunk);
+                    bin_stats.m_chunks_active += 1;
+                }
+                ASSERT(chunk->m_bin_index == bin_index);
+
+                // Take as many elements from this chunk as we need or as it can give, the free elements below the
+                // high-water mark are taken first, the high-water mark might move into pages that are not committed yet
+                u32 const take  = math::min(count - n, bin.m_max_alloc_count - (u32)chunk->m_elem_used_count);
+                u32 const holes = (u32)chunk->m_elem_free_index - (u32)chunk->m_elem_used_count;
+                u32 const high  = (u32)chunk->m_elem_free_index + (take > holes ? take - holes : 0);
+                if (((u64)high * bin.m_alloc_size) > ((u64)chunk->m_physical_pages << m_superspace->m_page_size_shift))
+                {
+                    if (!m_superspace->grow_chunk(chunk, bin, high))
+                        return n;  // Out of memory
+                }
+
+                void* const chunk_address = m_superspace->chunk_to_address(chunk);
+                for (u32 i = 0; i < take; ++i)
+                {
+                    s32 elem_index = nbitvec12::find_and_remove(&chunk->m_elem_free_bin0, chunk->m_elem_free_bin1, bin.m_max_alloc_count);
+                    if (elem_index < 0)
+                    {
+                        elem_index = chunk->m_elem_free_index++;
+                        nbitvec12::tick_lazy(&chunk->m_elem_free_bin0, chunk->m_elem_free_bin1, bin.m_max_alloc_count, elem_index);
+                    }
+                    ASSERT(elem_index < (s32)bin.m_max_alloc_count);
+                    if (chunk->m_elem_tag_array != nullptr)
+                        chunk->m_elem_tag_array[elem_index] = 0;
+                    if (chunk->m_elem_size_array != nullptr)
+                        chunk->m_elem_size_array[elem_index] = alloc_size;
+                    out[n++] = toaddress(chunk_address, (u64)elem_index * bin.m_alloc_size);
+                }
+
+                chunk->m_elem_used_count += (u16)take;
+                bin_stats.m_elements_used += take;
+                if (chunk->m_elem_used_count >= bin.m_max_alloc_count)
+                {
+                    // Chunk is full, so move it from the list of active chunks to the list of full chunks
+                    ll_remove(active_list(cLifetimeNormal, bin_index, s_bucket(bin, chunk->m_elem_used_count - take)), chunk);
+                    ll_insert(m_full_chunk_list, chunk);
+                    bin_stats.m_chunks_active -= 1;
+                    bin_stats.m_chunks_full += 1;
+                }
+                else
+                {
+                    update_bucket(chunk, bin, chunk->m_elem_used_count - take);
+                }
+            }
+            return n;
+        }
+
+        void superalloc_t::v_deallocate_n(void** ptrs, u32 count)
+        {
+            // Pointers are grouped per chunk, the counters and the list membership of a chunk are then
+            // updated once per group. Consecutive pointers are mostly from the same chunk, so we first check
+            // the address range of the last chunk before doing a full address to chunk lookup.
+            struct group_t
+            {
+                nsuperspace::chunk_t* m_chunk;
+                u32                   m_count;
+            };
+            static const u32 c_max_groups = 8;
+
+            group_t groups[c_max_groups];
+            u32     num_groups   = 0;
+            u32     last_group   = 0;
+            byte*   last_address = nullptr;
+            byte*   last_end     = nullptr;
+
+            for (u32 i = 0; i < count; ++i)
+            {
+                void* const ptr = ptrs[i];
+                if (ptr == nullptr)
+                    continue;
+
+                u32 g = last_group;
+                if (!(ptr >= last_address && ptr < last_end))
+                {
+                    ASSERT(ptr >= m_superspace->m_address_base && ptr < ((u8*)m_superspace->m_address_base + m_superspace->m_address_range));
+                    nsuperspace::chunk_t* chunk = m_superspace->address_to_chunk(ptr);
+                    if (chunk->m_owner_index != m_instance_index)
+                    {
+                        foreign_owner(chunk)->deallocate_deferred(chunk, ptr);
+                        continue;
+                    }
+
+                    for (g = 0; g < num_groups; ++g)
+                    {
+                        if (groups[g].m_chunk == chunk)
+                            break;
+                    }
+                    if (g == num_groups)
+                    {
+                        if (num_groups == c_max_groups)
+                        {
+                            // Flush all groups, we run out of space
+                            for (u32 f = 0; f < num_groups; ++f)
+                            {
+                                if (groups[f].m_count > 0)
+                                    release_elements(groups[f].m_chunk, groups[f].m_count);
+                            }
+                            num_groups = 0;
+                            g          = 0;
+                        }
+                        groups[g].m_chunk = chunk;
+                        groups[g].m_count = 0;
+                        num_groups += 1;
+                    }
+
+                    last_group   = g;
+                    last_address = (byte*)m_superspace->chunk_to_address(chunk);
+                    last_end     = last_address + ((u64)1 << chunk->m_section->m_chunk_config.m_sizeshift);
+                }
+
+                nsuperspace::chunk_t* chunk = groups[g].m_chunk;
+                if (release_element(chunk, m_config->m_abinconfigs[chunk->m_bin_index], ptr))
+                    groups[g].m_count += 1;
+            }
+
+            for (u32 f = 0; f < num_groups; ++f)
+            {
+                if (groups[f].m_count > 0)
+                    release_elements(groups[f].m_chunk, groups[f].m_count);
+            }
+        }
+
         void superalloc_t::v_deallocate(void* ptr)
         {
             if (ptr == nullptr)
@@ -600,45 +1894,152 @@ namespace ncore
 
             ASSERT(ptr >= m_superspace->m_address_base && ptr < ((u8*)m_superspace->m_address_base + m_superspace->m_address_range));
 
-            nsuperspace::chunk_t* chunk     = m_superspace->address_to_chunk(ptr);
-            const u8              bin_index = chunk->m_bin_index;
-            ASSERT(bin_index < m_config->m_num_binconfigs);
-            binconfig_t const& bin = m_config->m_abinconfigs[bin_index];
+            nsuperspace::chunk_t* chunk = m_superspace->address_to_chunk(ptr);
+            if (chunk->m_owner_index != m_instance_index)
+            {
+                // This element belongs to a chunk owned by another instance, we are not allowed to
+                // touch that chunk so we hand the element over to the owner.
+                foreign_owner(chunk)->deallocate_deferred(chunk, ptr);
+                return;
+            }
+
+            binconfig_t const& bin = m_config->m_abinconfigs[chunk->m_bin_index];
+            if (release_element(chunk, bin, ptr))
+                release_elements(chunk, 1);
+        }
 
+        // The instance of the threaded context of this instance that owns 'chunk'. A chunk of any other heap (a child
+        // or region heap, or a heap on another superspace) cannot be handed over, freeing into it would corrupt it.
+        superalloc_t* superalloc_t::foreign_owner(nsuperspace::chunk_t const* chunk) const
+        {
+            u16 const owner_index = chunk->m_owner_index;
+            if (m_instances == nullptr || owner_index >= m_max_instances || m_instances[owner_index] == nullptr)
             {
-                void* const chunk_address = m_superspace->chunk_to_address(chunk);
-                u32 const   elem_index    = (u32)(todistance(chunk_address, ptr) / bin.m_alloc_size);
-                ASSERT(elem_index < chunk->m_elem_free_index && elem_index < bin.m_max_alloc_count);
-                nbitvec12::clr(&chunk->m_elem_free_bin0, chunk->m_elem_free_bin1, bin.m_max_alloc_count, elem_index);
-                u32* elem_tag_array = chunk->m_elem_tag_array;
-                if (elem_tag_array[elem_index] == 0xFEFEEFEE)  // Double freeing this element ?
+                ASSERT(false);  // Freeing an element of another heap ?
+                nplatform::fatal("deallocate of an element that belongs to another heap");
+            }
+            return m_instances[owner_index];
+        }
+
+        // Called by a non-owning instance, this is wait-free for the element push. Only the thread that makes
+        // the deferred list of a chunk non-empty also pushes the chunk on the list of the owner, so a chunk
+        // is at most once in that list.
+        void superalloc_t::deallocate_deferred(nsuperspace::chunk_t* chunk, void* ptr)
+        {
+            void* head = natomic::load_ptr(&chunk->m_deferred_list);
+            do
+            {
+                *((void**)ptr) = head;
+            } while (!natomic::cas_ptr(&chunk->m_deferred_list, head, ptr));
+
+            if (head == nullptr)
+            {
+                void* chunks = natomic::load_ptr((void* volatile*)&m_deferred_chunks);
+                do
+                {
+                    chunk->m_deferred_next = (nsuperspace::chunk_t*)chunks;
+                } while (!natomic::cas_ptr((void* volatile*)&m_deferred_chunks, chunks, chunk));
+            }
+        }
+
+        // Called by the owner, reclaims the deferred elements chunk by chunk so that the counters and the
+        // list membership of a chunk are only updated once per batch.
+        void superalloc_t::collect_deferred()
+        {
+            nsuperspace::chunk_t* chunk = (nsuperspace::chunk_t*)natomic::exchange_ptr((void* volatile*)&m_deferred_chunks, nullptr);
+            while (chunk != nullptr)
+            {
+                // Read 'next' before detaching the elements, after that the chunk can be pushed again by other threads
+                nsuperspace::chunk_t* const next = chunk->m_deferred_next;
+                chunk->m_deferred_next           = nullptr;
+
+                binconfig_t const& bin   = m_config->m_abinconfigs[chunk->m_bin_index];
+                void*              item  = natomic::exchange_ptr(&chunk->m_deferred_list, nullptr);
+                u32                count = 0;
+                while (item != nullptr)
+                {
+                    void* const item_next = *((void**)item);
+                    if (release_element(chunk, bin, item))
+                        count += 1;
+                    item = item_next;
+                }
+                if (count > 0)
+                    release_elements(chunk, count);
+
+                chunk = next;
+            }
+        }
+
+        bool superalloc_t::release_element(nsuperspace::chunk_t* chunk, binconfig_t const& bin, void* ptr)
+        {
+            ASSERT(chunk->m_bin_index < m_config->m_num_binconfigs);
+            ASSERT(chunk->m_owner_index == m_instance_index);
+
+            void* const chunk_address = m_superspace->chunk_to_address(chunk);
+            u32 const   elem_index    = bin.offset_to_index(todistance(chunk_address, ptr));
+            ASSERT(elem_index < chunk->m_elem_free_index && elem_index < bin.m_max_alloc_count);
+            u32* elem_tag_array = chunk->m_elem_tag_array;
+            if (elem_tag_array == nullptr)
+            {
+                // Tagless, a freed element is a cleared bit in the free binmap
+                if (!nbitvec12::is_set(&chunk->m_elem_free_bin0, chunk->m_elem_free_bin1, bin.m_max_alloc_count, elem_index))  // Double freeing this element ?
                 {
                     ASSERT(false);
-                    return;
+                    return false;
                 }
-                elem_tag_array[elem_index] = 0xFEFEEFEE;  // Clear the tag for this element (mark it as freed)
+                nbitvec12::clr(&chunk->m_elem_free_bin0, chunk->m_elem_free_bin1, bin.m_max_alloc_count, elem_index);
+                return true;
+            }
+            if (elem_tag_array[elem_index] == 0xFEFEEFEE)  // Double freeing this element ?
+            {
+                ASSERT(false);
+                return false;
             }
+            nbitvec12::clr(&chunk->m_elem_free_bin0, chunk->m_elem_free_bin1, bin.m_max_alloc_count, elem_index);
+            elem_tag_array[elem_index] = 0xFEFEEFEE;  // Clear the tag for this element (mark it as freed)
+            return true;
+        }
 
-            // We have deallocated an element from this chunk
+        void superalloc_t::release_elements(nsuperspace::chunk_t* chunk, u32 count)
+        {
+            const u8           bin_index = (u8)chunk->m_bin_index;
+            binconfig_t const& bin       = m_config->m_abinconfigs[bin_index];
+            bin_stats_t&       bin_stats = m_bin_stats[bin_index];
+            ASSERT(count <= chunk->m_elem_used_count);
+
+            // We have deallocated element(s) from this chunk
             const bool chunk_was_full = (bin.m_max_alloc_count == chunk->m_elem_used_count);
-            chunk->m_elem_used_count--;
+            chunk->m_elem_used_count -= (u16)count;
+            bin_stats.m_elements_used -= count;
             const bool chunk_is_empty = (0 == chunk->m_elem_used_count);
+            if (chunk_was_full)
+                bin_stats.m_chunks_full -= 1;
+            else
+                bin_stats.m_chunks_active -= 1;
+            if (!chunk_is_empty)
+                bin_stats.m_chunks_active += 1;
 
             // Check the state of this chunk, was it full before we deallocated an element?
             // Or maybe now it has become empty ?
+            if (chunk_was_full)
+                ll_remove(m_full_chunk_list, chunk);
             if (chunk_is_empty)
             {
                 if (!chunk_was_full)
                 {
                     // We are going to release this chunk, so remove it from the active chunk list before doing that.
-                    ll_remove(m_active_chunk_list_per_bin[bin_index], chunk);
+                    ll_remove(active_list(chunk->m_lifetime, bin_index, s_bucket(bin, count)), chunk);
                 }
                 m_superspace->release_chunk(chunk, m_internal_fsa);
             }
             else if (chunk_was_full)
             {
                 // Ok, this chunk can be used to allocate from again, so add it to the list of active chunks
-                ll_insert(m_active_chunk_list_per_bin[bin_index], chunk);
+                ll_insert(active_list(chunk->m_lifetime, bin_index, s_bucket(bin, chunk->m_elem_used_count)), chunk);
+            }
+            else
+            {
+                update_bucket(chunk, bin, chunk->m_elem_used_count + count);
             }
         }
 
@@ -648,7 +2049,9 @@ namespace ncore
                 return 0;
             ASSERT(ptr >= m_superspace->m_address_base && ptr < ((u8*)m_superspace->m_address_base + m_superspace->m_address_range));
             nsuperspace::chunk_t* chunk = m_superspace->address_to_chunk(ptr);
-            binconfig_t const&    bin   = m_config->m_abinconfigs[chunk->m_bin_index];
+            if (chunk->m_bin_index >= m_config->m_alignedbin_index)
+                return chunk->m_physical_pages << m_superspace->m_page_size_shift;  // The committed part of an aligned chunk
+            binconfig_t const& bin = m_config->m_abinconfigs[chunk->m_bin_index];
             return bin.m_alloc_size;
         }
 
@@ -660,14 +2063,82 @@ namespace ncore
 
         u32 superalloc_t::v_get_tag(void* ptr) const { return (ptr == nullptr) ? 0xffffffff : m_superspace->get_tag(ptr); }
 
+        void superalloc_t::v_get_stats(stats_t& stats) const
+        {
+            // Sections and chunks are shared by all instances, the bins are the ones of this instance
+            m_superspace->get_stats(stats);
+
+            stats.m_num_binconfigs = (u32)math::min((s32)m_config->m_num_binconfigs, (s32)stats_t::cMaxBinConfigs);
+            for (u32 i = 0; i < stats.m_num_binconfigs; i++)
+                stats.m_bins[i] = m_bin_stats[i];
+
+            if (m_internal_fsa != m_superspace->m_fsa)
+                stats.m_internal_fsa_size += nfsa::get_used_size(m_internal_fsa);
+        }
+
+        void superalloc_t::v_record_sizes(bool enable) { m_superspace->m_record_sizes = enable; }
+
+        void superalloc_t::v_analyze(fragmentation_t& report) const
+        {
+            nmem::memset(&report, 0, sizeof(fragmentation_t));
+            m_superspace->analyze(report);
+        }
+
+        void superalloc_t::v_visit(visit_fn fn, void* user) const { m_superspace->visit(fn, user); }
+
+        void superalloc_t::v_release() { m_superspace->trim(0); }
+
+        u64 superalloc_t::v_trim(u64 target_bytes) { return m_superspace->trim(target_bytes); }
+
+        void superalloc_t::v_set_pressure_source(pressure_fn fn, void* user, u32 interval_ms)
+        {
+            scoped_spinlock_t lock(m_superspace->m_lock);
+            m_superspace->m_pressure_fn          = fn;
+            m_superspace->m_pressure_user        = user;
+            m_superspace->m_pressure_interval_ms = interval_ms;
+            natomic::store_u64(&m_superspace->m_pressure_poll_time, nplatform::time_ms());
+            natomic::store_s32(&m_superspace->m_pressure_enabled, fn != nullptr ? 1 : 0);
+        }
+
+        bool gCgroupMemoryPressure(void* user, u64& target_bytes)
+        {
+            u32 const threshold  = user != nullptr ? *(u32 const*)user : 1000;
+            u32       some_avg10 = 0;
+            if (!nplatform::memory_pressure(some_avg10) || some_avg10 < threshold)
+                return false;
+            target_bytes = 0;
+            return true;
+        }
+
     }  // namespace nsuperalloc
 
-    nsuperalloc::vmalloc_t* gCreateVmAllocator(alloc_t* main_heap)
+    nsuperalloc::vmalloc_t* gCreateVmAllocator(alloc_t* main_heap, bool tagless)
     {
         // nsuperalloc::config_t const* config  = nsuperalloc::gConfigWindowsDesktopApp10p();
-        nsuperalloc::config_t const* config     = nsuperalloc::gConfigWindowsDesktopApp25p();
-        nsuperalloc::superalloc_t*   superalloc = new (main_heap->allocate(sizeof(nsuperalloc::superalloc_t))) nsuperalloc::superalloc_t(main_heap);
-        superalloc->initialize(config);
+        nsuperalloc::config_t const* config = nsuperalloc::gConfigWindowsDesktopApp25p();
+        return gCreateVmAllocator(main_heap, config, tagless);
+    }
+
+    // Note: The config must outlive the allocator
+    nsuperalloc::vmalloc_t* gCreateVmAllocator(alloc_t* main_heap, nsuperalloc::config_t const* config, bool tagless)
+    {
+        nsuperalloc::superalloc_t* superalloc = new (main_heap->allocate(sizeof(nsuperalloc::superalloc_t))) nsuperalloc::superalloc_t(main_heap);
+        superalloc->initialize(config, tagless, nullptr, nsuperalloc::gOsBackend());
+        return superalloc;
+    }
+
+    nsuperalloc::vmalloc_t* gCreateVmAllocator(alloc_t* main_heap, nsuperalloc::config_t const* config, nsuperalloc::numa_t const& numa, bool tagless)
+    {
+        nsuperalloc::superalloc_t* superalloc = new (main_heap->allocate(sizeof(nsuperalloc::superalloc_t))) nsuperalloc::superalloc_t(main_heap);
+        superalloc->initialize(config, tagless, &numa, nsuperalloc::gOsBackend());
+        return superalloc;
+    }
+
+    // Note: The backend must outlive the allocator
+    nsuperalloc::vmalloc_t* gCreateVmAllocator(alloc_t* main_heap, nsuperalloc::config_t const* config, nsuperalloc::backend_t* backend, bool tagless)
+    {
+        nsuperalloc::superalloc_t* superalloc = new (main_heap->allocate(sizeof(nsuperalloc::superalloc_t))) nsuperalloc::superalloc_t(main_heap);
+        superalloc->initialize(config, tagless, nullptr, backend);
         return superalloc;
     }
 
@@ -675,24 +2146,246 @@ namespace ncore
     {
         nsuperalloc::superalloc_t* superalloc     = static_cast<nsuperalloc::superalloc_t*>(valloc);
         alloc_t*                   main_allocator = superalloc->m_main_allocator;
+
+        // The chunks of a heap on a shared superspace (a region) go back to that superspace
+        if (!superalloc->m_owns_superspace)
+            superalloc->release_all_chunks();
         superalloc->deinitialize();
         g_destruct(main_allocator, superalloc);
     }
 
-    namespace nvmalloc
+    nsuperalloc::vmalloc_t* gCreateChildHeap(nsuperalloc::vmalloc_t* parent)
+    {
+        nsuperalloc::superalloc_t* superparent = static_cast<nsuperalloc::superalloc_t*>(parent);
+        alloc_t*                   main_heap   = superparent->m_main_allocator;
+        nsuperalloc::superalloc_t* child       = new (main_heap->allocate(sizeof(nsuperalloc::superalloc_t))) nsuperalloc::superalloc_t(main_heap);
+        child->initialize(superparent);
+        return child;
+    }
+
+    void gDestroyChildHeap(nsuperalloc::vmalloc_t* child)
     {
-        class vmalloc_instance_t
+        nsuperalloc::superalloc_t* superchild     = static_cast<nsuperalloc::superalloc_t*>(child);
+        alloc_t*                   main_allocator = superchild->m_main_allocator;
+        ASSERT(superchild->m_parent != nullptr);
+        superchild->release_all_chunks();
+        superchild->deinitialize();
+        g_destruct(main_allocator, superchild);
+    }
+
+    // --------------------------------------------------------------------------------------------
+    // Super memory
+    //
+    // One address range is reserved for all regions, every region gets a part of (1 << m_region_shift) bytes, the
+    // largest address size of the region configs. The base is aligned to the largest section size of the configs,
+    // so every superspace gets an aligned base without reserving a range of its own.
+
+    struct supermemory_t
+    {
+        alloc_t*                           m_main_allocator;
+        byte*                              m_address_reserved;  //
+        byte*                              m_address_base;      // Region i starts at m_address_base + (i << m_region_shift)
+        u64                                m_address_size;      // The size of the reserved range
+        nsuperalloc::nsuperspace::alloc_t* m_regions;           // One superspace per region
+        arena_t**                          m_region_heaps;      // The internal heap of every region
+        fsa_t**                            m_region_fsas;       // The fsa of every region, every superspace has its own lock
+        u32                                m_num_regions;       //
+        s8                                 m_region_shift;      //
+
+        DCORE_CLASS_PLACEMENT_NEW_DELETE
+    };
+
+    static nsuperalloc::config_t const* s_region_config(nsuperalloc::region_t const& region) { return region.m_config != nullptr ? region.m_config : nsuperalloc::gConfigWindowsDesktopApp25p(); }
+
+    supermemory_t* gCreateSuperMemory(alloc_t* main_heap, nsuperalloc::region_t const* regions, u32 num_regions, bool tagless)
+    {
+        ASSERT(num_regions > 0);
+
+        u64 region_size     = 0;
+        u64 section_maxsize = 0;
+        for (u32 i = 0; i < num_regions; ++i)
         {
-        public:
-            nsuperalloc::nsuperspace::alloc_t* m_superspace;      // shared among instances
-            arena_t                            m_internal_heap;   // per instance
-            fsa_t*                             m_internal_fsa;    // per instance
-            s16                                m_instance_index;  // instance index
-
-            // We need to defer all deallocations here so that we can release them when on the owning thread.
-            // Using the allocations as a linked-list is best for this purpose, so that we do not need to
-            // allocate memory for a separate array or a separate list.
-        };
-    }  // namespace nvmalloc
+            nsuperalloc::config_t const* config = s_region_config(regions[i]);
+            region_size                         = math::max(region_size, config->m_total_address_size);
+            section_maxsize                     = math::max(section_maxsize, (u64)1 << config->m_section_maxsize_shift);
+        }
+
+        supermemory_t* memory      = new (main_heap->allocate(sizeof(supermemory_t))) supermemory_t();
+        memory->m_main_allocator   = main_heap;
+        memory->m_num_regions      = num_regions;
+        memory->m_region_shift     = (s8)math::ilog2(region_size);
+        memory->m_address_size     = ((u64)num_regions << memory->m_region_shift) + section_maxsize;
+        memory->m_address_reserved = (byte*)nsuperalloc::gOsBackend()->reserve(memory->m_address_size);
+        memory->m_address_base     = (byte*)(((ptr_t)memory->m_address_reserved + (section_maxsize - 1)) & ~(ptr_t)(section_maxsize - 1));
+        memory->m_regions          = g_allocate_array_and_clear<nsuperalloc::nsuperspace::alloc_t>(main_heap, num_regions);
+        memory->m_region_heaps     = g_allocate_array_and_clear<arena_t*>(main_heap, num_regions);
+        memory->m_region_fsas      = g_allocate_array_and_clear<fsa_t*>(main_heap, num_regions);
+
+        for (u32 i = 0; i < num_regions; ++i)
+        {
+            nsuperalloc::config_t const* config = s_region_config(regions[i]);
+            memory->m_region_heaps[i]           = narena::new_arena(config->m_internal_heap_address_range, config->m_internal_heap_pre_size);
+            memory->m_region_fsas[i]            = nfsa::new_fsa(config->m_internal_fsa_block_count);
+            memory->m_regions[i].initialize(config, memory->m_region_heaps[i], memory->m_region_fsas[i], tagless, nullptr, &regions[i], memory->m_address_base + ((u64)i << memory->m_region_shift), nsuperalloc::gOsBackend());
+        }
+        return memory;
+    }
+
+    void gDestroySuperMemory(supermemory_t* memory)
+    {
+        for (u32 i = 0; i < memory->m_num_regions; ++i)
+        {
+            memory->m_regions[i].deinitialize(memory->m_region_heaps[i]);
+            nfsa::destroy(memory->m_region_fsas[i]);
+            narena::destroy(memory->m_region_heaps[i]);
+        }
+        nsuperalloc::gOsBackend()->release(memory->m_address_reserved, memory->m_address_size);
+
+        alloc_t* main_allocator = memory->m_main_allocator;
+        g_deallocate(main_allocator, memory->m_regions);
+        g_deallocate(main_allocator, memory->m_region_heaps);
+        g_deallocate(main_allocator, memory->m_region_fsas);
+        g_destruct(main_allocator, memory);
+    }
+
+    nsuperalloc::vmalloc_t* gCreateVmAllocator(supermemory_t* memory, u32 region_index)
+    {
+        ASSERT(region_index < memory->m_num_regions);
+        nsuperalloc::nsuperspace::alloc_t* superspace = &memory->m_regions[region_index];
+        alloc_t*                           main_heap  = memory->m_main_allocator;
+        nsuperalloc::superalloc_t*         superalloc = new (main_heap->allocate(sizeof(nsuperalloc::superalloc_t))) nsuperalloc::superalloc_t(main_heap);
+        superalloc->initialize(superspace->m_config, superspace, nullptr, 0, superspace->new_owner_index());
+        return superalloc;
+    }
+
+    u32 gRegionOf(supermemory_t const* memory, void const* ptr)
+    {
+        if (ptr < memory->m_address_base)
+            return memory->m_num_regions;
+        u64 const region = (u64)((byte const*)ptr - memory->m_address_base) >> memory->m_region_shift;
+        return region < memory->m_num_regions ? (u32)region : memory->m_num_regions;
+    }
+
+    void gProtectRegion(supermemory_t* memory, u32 region_index, u8 protect)
+    {
+        ASSERT(region_index < memory->m_num_regions);
+        memory->m_regions[region_index].protect(protect);
+    }
+
+    // --------------------------------------------------------------------------------------------
+    // Multi-threaded usage
+    //
+    // Every thread obtains its own allocator instance (own active chunk lists, own internal heap and
+    // fsa) which all share a single superspace. Allocating and freeing memory owned by the calling
+    // instance does not take any lock, only obtaining or releasing a chunk takes the superspace lock.
+    // Freeing an element that is owned by another instance pushes the element (lock-free) on the
+    // deferred list of its chunk, the owner reclaims those elements per chunk in 'allocate' or when
+    // calling gVmAllocatorCollectDeferred().
+
+    struct vm_allocator_threaded_context_t
+    {
+        alloc_t*                           m_main_allocator;
+        nsuperalloc::config_t const*       m_config;
+        arena_t*                           m_internal_heap;
+        fsa_t*                             m_internal_fsa;
+        nsuperalloc::nsuperspace::alloc_t* m_superspace;
+        nsuperalloc::superalloc_t**        m_instances;
+        s16                                m_max_instances;
+        spinlock_t                         m_lock;
+
+        DCORE_CLASS_PLACEMENT_NEW_DELETE
+    };
+
+    struct vm_allocator_threaded_t : public nsuperalloc::superalloc_t
+    {
+        vm_allocator_threaded_t(alloc_t* main_allocator)
+            : superalloc_t(main_allocator)
+        {
+        }
+
+        DCORE_CLASS_PLACEMENT_NEW_DELETE
+    };
+
+    static vm_allocator_threaded_context_t* s_create_threaded_context(alloc_t* main_heap, s16 max_threads, bool tagless, nsuperalloc::numa_t const* numa)
+    {
+        ASSERT(max_threads > 0);
+
+        nsuperalloc::config_t const*     config = nsuperalloc::gConfigWindowsDesktopApp25p();
+        vm_allocator_threaded_context_t* ctxt   = new (main_heap->allocate(sizeof(vm_allocator_threaded_context_t))) vm_allocator_threaded_context_t();
+
+        ctxt->m_main_allocator = main_heap;
+        ctxt->m_config         = config;
+        ctxt->m_internal_heap  = narena::new_arena(config->m_internal_heap_address_range, config->m_internal_heap_pre_size);
+        ctxt->m_internal_fsa   = nfsa::new_fsa(config->m_internal_fsa_block_count);
+        ctxt->m_superspace     = g_allocate<nsuperalloc::nsuperspace::alloc_t>(ctxt->m_internal_heap);
+        ctxt->m_superspace->initialize(config, ctxt->m_internal_heap, ctxt->m_internal_fsa, tagless, numa, nullptr, nullptr, nsuperalloc::gOsBackend());
+        ctxt->m_instances     = g_allocate_array_and_clear<nsuperalloc::superalloc_t*>(ctxt->m_internal_heap, max_threads);
+        ctxt->m_max_instances = max_threads;
+        ctxt->m_lock.initialize();
+        for (s16 i = 0; i < max_threads; i++)
+            ctxt->m_instances[i] = nullptr;
+
+        return ctxt;
+    }
+
+    vm_allocator_threaded_context_t* gCreateVmAllocatorThreadedContext(alloc_t* main_heap, s16 max_threads, bool tagless) { return s_create_threaded_context(main_heap, max_threads, tagless, nullptr); }
+
+    vm_allocator_threaded_context_t* gCreateVmAllocatorThreadedContext(alloc_t* main_heap, nsuperalloc::numa_t const& numa, s16 max_threads, bool tagless) { return s_create_threaded_context(main_heap, max_threads, tagless, &numa); }
+
+    void gDestroyVmAllocatorThreadedContext(vm_allocator_threaded_context_t* ctxt)
+    {
+        for (s16 i = 0; i < ctxt->m_max_instances; i++)
+        {
+            nsuperalloc::superalloc_t* instance = ctxt->m_instances[i];
+            if (instance != nullptr)
+            {
+                vm_allocator_threaded_t* allocator = static_cast<vm_allocator_threaded_t*>(instance);
+                allocator->deinitialize();
+                g_destruct(ctxt->m_main_allocator, allocator);
+                ctxt->m_instances[i] = nullptr;
+            }
+        }
+
+        ctxt->m_superspace->deinitialize(ctxt->m_internal_heap);
+        g_deallocate(ctxt->m_internal_heap, ctxt->m_superspace);
+
+        nfsa::destroy(ctxt->m_internal_fsa);
+        narena::destroy(ctxt->m_internal_heap);
+
+        alloc_t* main_allocator = ctxt->m_main_allocator;
+        g_destruct(main_allocator, ctxt);
+    }
+
+    vm_allocator_threaded_t* gCreateVmAllocatorForThread(vm_allocator_threaded_context_t* ctxt, s16 thread_index)
+    {
+        ASSERT(thread_index >= 0 && thread_index < ctxt->m_max_instances);
+
+        scoped_spinlock_t lock(ctxt->m_lock);
+
+        // An instance that was finalized still owns the chunks of its live allocations, the next
+        // thread that uses the same index adopts it.
+        nsuperalloc::superalloc_t* instance = ctxt->m_instances[thread_index];
+        if (instance == nullptr)
+        {
+            vm_allocator_threaded_t* allocator = new (ctxt->m_main_allocator->allocate(sizeof(vm_allocator_threaded_t))) vm_allocator_threaded_t(ctxt->m_main_allocator);
+            allocator->initialize(ctxt->m_config, ctxt->m_superspace, ctxt->m_instances, (u16)ctxt->m_max_instances, (u16)thread_index);
+            ctxt->m_instances[thread_index] = allocator;
+            instance                        = allocator;
+        }
+        return static_cast<vm_allocator_threaded_t*>(instance);
+    }
+
+    void gFinalizeVmAllocatorForThread(vm_allocator_threaded_context_t* ctxt, vm_allocator_threaded_t* allocator)
+    {
+        ASSERT(allocator != nullptr && allocator->m_instances == ctxt->m_instances);
+
+        // Reclaim whatever other threads have handed back to us, the instance itself stays registered
+        // since other threads may still free elements that live in chunks owned by this instance.
+        allocator->collect_deferred();
+    }
+
+    nsuperalloc::vmalloc_t* gGetVmAllocatorOfThread(vm_allocator_threaded_t* allocator) { return allocator; }
+
+    void gVmAllocatorCollectDeferred(vm_allocator_threaded_t* allocator) { allocator->collect_deferred(); }
 
 }  // namespace ncore
@@ -0,0 +1,237 @@
+#include "ccore/c_target.h"
+#include "ccore/c_allocator.h"
+#include "ccore/c_debug.h"
+#include "ccore/c_memory.h"
+
+#include "csuperalloc/private/c_multithread.h"
+#include "csuperalloc/c_superalloc.h"
+
+namespace ncore
+{
+    namespace nsuperalloc
+    {
+        static inline bool s_is_page_aligned(u64 value, s8 page_size_shift) { return (value & (((u64)1 << page_size_shift) - 1)) == 0; }
+
+        static inline void s_clear_stats(backend_stats_t& stats)
+        {
+            stats.m_reserved_bytes       = 0;
+            stats.m_committed_bytes      = 0;
+            stats.m_peak_committed_bytes = 0;
+            stats.m_commit_calls         = 0;
+            stats.m_decommit_calls       = 0;
+        }
+
+        static inline void s_count_commit(backend_stats_t& stats, u64 size)
+        {
+            stats.m_committed_bytes += size;
+            stats.m_commit_calls += 1;
+            if (stats.m_committed_bytes > stats.m_peak_committed_bytes)
+                stats.m_peak_committed_bytes = stats.m_committed_bytes;
+        }
+
+        static inline void s_count_decommit(backend_stats_t& stats, u64 size)
+        {
+            ASSERT(size <= stats.m_committed_bytes);  // Decommitting more than was committed ?
+            stats.m_committed_bytes -= size;
+            stats.m_decommit_calls += 1;
+        }
+
+        // --------------------------------------------------------------------------------------------
+        // The virtual memory of the OS
+        class os_backend_t : public backend_t
+        {
+        protected:
+            virtual void* v_reserve(u64 size) { return v_alloc_reserve((int_t)size); }
+            virtual void  v_release(void* address, u64 size) { v_alloc_release(address, (int_t)size); }
+            virtual bool  v_commit(void* address, u64 size) { return v_alloc_commit(address, (int_t)size); }
+            virtual void  v_decommit(void* address, u64 size) { v_alloc_decommit(address, (int_t)size); }
+            virtual s8    v_page_size_shift() const { return (s8)v_alloc_get_page_size_shift(); }
+            virtual void  v_get_stats(backend_stats_t& stats) const { s_clear_stats(stats); }
+        };
+
+        static os_backend_t s_os_backend;
+
+        backend_t* gOsBackend() { return &s_os_backend; }
+
+        // --------------------------------------------------------------------------------------------
+        // Addresses without memory, every reservation takes the next part of the range that starts at 'base'
+        class offset_backend_t : public backend_t
+        {
+        public:
+            offset_backend_t(u64 base, s8 page_size_shift)
+                : m_next(base)
+                , m_page_size_shift(page_size_shift)
+            {
+                s_clear_stats(m_stats);
+                m_lock.initialize();
+            }
+
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+
+        protected:
+            virtual void* v_reserve(u64 size)
+            {
+                scoped_spinlock_t lock(m_lock);
+                void* const       address = (void*)m_next;
+                m_next += size;
+                m_stats.m_reserved_bytes += size;
+                return address;
+            }
+
+            virtual void v_release(void*, u64 size)
+            {
+                scoped_spinlock_t lock(m_lock);
+                m_stats.m_reserved_bytes -= size;
+            }
+
+            virtual bool v_commit(void*, u64 size)
+            {
+                scoped_spinlock_t lock(m_lock);
+                s_count_commit(m_stats, size);
+                return true;
+            }
+
+            virtual void v_decommit(void*, u64 size)
+            {
+                scoped_spinlock_t lock(m_lock);
+                s_count_decommit(m_stats, size);
+            }
+
+            virtual s8 v_page_size_shift() const { return m_page_size_shift; }
+
+            virtual void v_get_stats(backend_stats_t& stats) const
+            {
+                scoped_spinlock_t lock(m_lock);
+                stats = m_stats;
+            }
+
+            u64                m_next;
+            backend_stats_t    m_stats;
+            mutable spinlock_t m_lock;
+            s8                 m_page_size_shift;
+        };
+
+        backend_t* gCreateOffsetBackend(alloc_t* heap, u64 base, s8 page_size_shift)
+        {
+            ASSERT(base != 0 && page_size_shift >= 12);
+            return new (heap->allocate(sizeof(offset_backend_t))) offset_backend_t(base, page_size_shift);
+        }
+
+        // --------------------------------------------------------------------------------------------
+        // A device heap simulated with host memory. Committed memory is filled with a pattern instead of zeros, like
+        // device memory that is not cleared, and every call is checked against the reservations.
+        class device_mock_backend_t : public backend_t
+        {
+        public:
+            enum
+            {
+                cMaxReservations = 8,
+                cCommitPattern   = 0xDD,
+            };
+
+            device_mock_backend_t()
+                : m_num_reservations(0)
+                , m_page_size_shift((s8)v_alloc_get_page_size_shift())
+            {
+                s_clear_stats(m_stats);
+                m_lock.initialize();
+            }
+
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+
+        protected:
+            struct reservation_t
+            {
+                byte* m_address;
+                u64   m_size;
+            };
+
+            bool is_reserved(void* address, u64 size) const
+            {
+                for (u32 i = 0; i < m_num_reservations; ++i)
+                {
+                    reservation_t const& r = m_reservations[i];
+                    if ((byte*)address >= r.m_address && ((byte*)address + size) <= (r.m_address + r.m_size))
+                        return true;
+                }
+                return false;
+            }
+
+            virtual void* v_reserve(u64 size)
+            {
+                scoped_spinlock_t lock(m_lock);
+                ASSERT(m_num_reservations < cMaxReservations);
+                void* const address = v_alloc_reserve((int_t)size);
+                if (address != nullptr && m_num_reservations < cMaxReservations)
+                {
+                    m_reservations[m_num_reservations].m_address = (byte*)address;
+                    m_reservations[m_num_reservations].m_size    = size;
+                    m_num_reservations += 1;
+                    m_stats.m_reserved_bytes += size;
+                }
+                return address;
+            }
+
+            virtual void v_release(void* address, u64 size)
+            {
+                scoped_spinlock_t lock(m_lock);
+                for (u32 i = 0; i < m_num_reservations; ++i)
+                {
+                    if (m_reservations[i].m_address == address)
+                    {
+                        ASSERT(m_reservations[i].m_size == size);
+                        m_reservations[i] = m_reservations[--m_num_reservations];
+                        m_stats.m_reserved_bytes -= size;
+                        v_alloc_release(address, (int_t)size);
+                        return;
+                    }
+                }
+                ASSERT(false);  // Not a reservation of this backend
+            }
+
+            virtual bool v_commit(void* address, u64 size)
+            {
+                scoped_spinlock_t lock(m_lock);
+                ASSERT(s_is_page_aligned((u64)address, m_page_size_shift) && s_is_page_aligned(size, m_page_size_shift));
+                ASSERT(is_reserved(address, size));
+                if (!v_alloc_commit(address, (int_t)size))
+                    return false;
+                nmem::memset(address, cCommitPattern, (int_t)size);
+                s_count_commit(m_stats, size);
+                return true;
+            }
+
+            virtual void v_decommit(void* address, u64 size)
+            {
+                scoped_spinlock_t lock(m_lock);
+                ASSERT(s_is_page_aligned((u64)address, m_page_size_shift) && s_is_page_aligned(size, m_page_size_shift));
+                ASSERT(is_reserved(address, size));
+                v_alloc_decommit(address, (int_t)size);
+                s_count_decommit(m_stats, size);
+            }
+
+            virtual s8 v_page_size_shift() const { return m_page_size_shift; }
+
+            virtual void v_get_stats(backend_stats_t& stats) const
+            {
+                scoped_spinlock_t lock(m_lock);
+                stats = m_stats;
+            }
+
+            reservation_t      m_reservations[cMaxReservations];
+            u32                m_num_reservations;
+            backend_stats_t    m_stats;
+            mutable spinlock_t m_lock;
+            s8                 m_page_size_shift;
+        };
+
+        backend_t* gCreateDeviceMockBackend(alloc_t* heap) { return new (heap->allocate(sizeof(device_mock_backend_t))) device_mock_backend_t(); }
+
+        void gDestroyBackend(alloc_t* heap, backend_t* backend)
+        {
+            if (backend != nullptr && backend != &s_os_backend)
+                g_destruct(heap, backend);
+        }
+
+    }  // namespace nsuperalloc
+}  // namespace ncore
@@ -1,6 +1,8 @@
 #include "ccore/c_target.h"
 #include "ccore/c_debug.h"
 #include "ccore/c_math.h"
+#include "ccore/c_allocator.h"
+#include "cbase/c_allocator.h"
 
 #include "csuperalloc/c_superalloc_config.h"
 
@@ -24,18 +26,33 @@ namespace ncore
         static const s8 sSectionSize_Min = sSectionSize_64MB;  // Minimum section size is 64MB (1 << 26)
         static const s8 sSectionSize_Max = sSectionSize_1GB;   // Maximum section size is 1GB  (1 << 30)
 
-        static const chunkconfig_t c64KB              = {16, 0, 4, sSectionSize_64MB};
-        static const chunkconfig_t c128KB             = {17, 1, 2, sSectionSize_64MB};
-        static const chunkconfig_t c256KB             = {18, 2, 1, sSectionSize_64MB};
-        static const chunkconfig_t c512KB             = {19, 3, 0, sSectionSize_128MB};
-        static const chunkconfig_t c2MB               = {21, 4, -1, sSectionSize_256MB};
-        static const chunkconfig_t c8MB               = {23, 5, -1, sSectionSize_512MB};
-        static const chunkconfig_t c32MB              = {25, 6, -1, sSectionSize_512MB};
-        static const chunkconfig_t c128MB             = {27, 7, -1, sSectionSize_512MB};
-        static const chunkconfig_t c512MB             = {29, 8, -1, sSectionSize_1GB};
+        // Chunks of 8MB and larger are backed by huge pages, their bins are large enough that committing in huge
+        // page granularity costs little. Smaller chunks are not, for them (and the aligned bins that use them)
+        // committing only the pages that are needed matters more.
+        static const chunkconfig_t c64KB              = {16, 0, 4, sSectionSize_64MB, 0};
+        static const chunkconfig_t c128KB             = {17, 1, 2, sSectionSize_64MB, 0};
+        static const chunkconfig_t c256KB             = {18, 2, 1, sSectionSize_64MB, 0};
+        static const chunkconfig_t c512KB             = {19, 3, 0, sSectionSize_128MB, 0};
+        static const chunkconfig_t c2MB               = {21, 4, -1, sSectionSize_256MB, 0};
+        static const chunkconfig_t c8MB               = {23, 5, -1, sSectionSize_512MB, 1};
+        static const chunkconfig_t c32MB              = {25, 6, -1, sSectionSize_512MB, 1};
+        static const chunkconfig_t c128MB             = {27, 7, -1, sSectionSize_512MB, 1};
+        static const chunkconfig_t c512MB             = {29, 8, -1, sSectionSize_1GB, 1};
         static const chunkconfig_t c_achunkconfigs[]  = {c64KB, c128KB, c256KB, c512KB, c2MB, c8MB, c32MB, c128MB, c512MB};
         static const u32           c_num_chunkconfigs = sizeof(c_achunkconfigs) / sizeof(chunkconfig_t);
 
+        // Every entry covers 8 sizes and holds the bin of the largest of them, since bin sizes are multiples
+        // of 8 this is the same bin size that size2bin gives for each of them. Sizes below 8 use the bin of 8
+        // (size2bin is not defined for sizes below 8).
+        void config_t::setup_small_size2bin()
+        {
+            for (s32 i = 0; i < cSmallSizeCount; i++)
+            {
+                u32 const size      = math::max((u32)i << cSmallSizeShift, (u32)1 << cSmallSizeShift);
+                m_small_size2bin[i] = size2bin(size);
+            }
+        }
+
         namespace nsuperalloc_config_25p
         {
             // clang-format off
@@ -98,8 +115,16 @@ namespace ncore
                 binconfig_t( 256 * cMB, c512MB),                  binconfig_t( 320*cMB, c512MB),                   // 256MB, 320MB
                 binconfig_t( 384 * cMB, c512MB),                  binconfig_t( 448*cMB, c512MB),                   // 384MB, 448MB
                 binconfig_t( 512 * cMB, c512MB),                                                                       // 512MB
+
+                // Aligned bins, a single element per chunk, one for each chunk config (see config_t::m_alignedbin_index)
+                binconfig_t(  64 * cKB, c64KB),                    binconfig_t( 128*cKB, c128KB),                    //  64KB, 128KB
+                binconfig_t( 256 * cKB, c256KB),                   binconfig_t( 512*cKB, c512KB),                    // 256KB, 512KB
+                binconfig_t(   2 * cMB, c2MB),                     binconfig_t(   8*cMB, c8MB),                      //   2MB, 8MB
+                binconfig_t(  32 * cMB, c32MB),                    binconfig_t( 128*cMB, c128MB),                    //  32MB, 128MB
+                binconfig_t( 512 * cMB, c512MB),                                                                       // 512MB
             };
-            static const s32        c_num_binconfigs = sizeof(c_abinconfigs) / sizeof(binconfig_t);
+            static const s32        c_num_binconfigs   = sizeof(c_abinconfigs) / sizeof(binconfig_t);
+            static const s32        c_alignedbin_index = c_num_binconfigs - c_num_chunkconfigs;
             // clang-format on
 
             // Note: It is preferable to analyze the memory usage of the application and adjust the superallocator configuration accordingly
@@ -132,6 +157,8 @@ namespace ncore
             const u32 c_internal_heap_pre_size      = 4 * cMB;
             const u32 c_internal_fsa_block_count    = 1024;
             const u32 c_internal_fsa_block_size     = 64 * cKB;
+            const u32 c_section_cache_count         = 1;
+            const u32 c_section_cache_time_ms       = 10000;
 
             nsuperalloc_config_25p::config_25p_t* config = &nsuperalloc_config_25p::s_config;
 
@@ -141,25 +168,20 @@ namespace ncore
             config->m_internal_heap_pre_size      = c_internal_heap_pre_size;
             config->m_internal_fsa_block_count    = c_internal_fsa_block_count;
             config->m_internal_fsa_block_size     = c_internal_fsa_block_size;
+            config->m_section_cache_count         = c_section_cache_count;
+            config->m_section_cache_time_ms       = c_section_cache_time_ms;
             config->m_section_minsize_shift       = sSectionSize_Min;
             config->m_section_maxsize_shift       = sSectionSize_Max;
             config->m_num_chunkconfigs            = c_num_chunkconfigs;
             config->m_num_binconfigs              = nsuperalloc_config_25p::c_num_binconfigs;
+            config->m_alignedbin_index            = nsuperalloc_config_25p::c_alignedbin_index;
+            config->m_static_size2bin             = true;
             config->m_achunkconfigs               = c_achunkconfigs;
             config->m_abinconfigs                 = nsuperalloc_config_25p::c_abinconfigs;
+            config->setup_small_size2bin();
 
 #ifdef SUPERALLOC_DEBUG
-            // sanity check the configuration
-            for (s16 s = 0; s < config->m_num_binconfigs; s++)
-            {
-                ASSERT(config->m_abinconfigs[s].m_max_alloc_count >= 1);
-                u32 const          size      = config->m_abinconfigs[s].m_alloc_size;
-                u8 const           bin_index = config->size2bin(size);
-                binconfig_t const& bin       = config->m_abinconfigs[bin_index];
-                ASSERT(size <= bin.m_alloc_size);
-                ASSERT(bin.m_max_alloc_count >= 1);
-                ASSERT(bin.m_max_alloc_count <= 4096);  // The binmap we use can only handle max 4096 bits
-            }
+            ASSERT(gConfigValidate(config));  // sanity check the configuration
 #endif
             return config;
         }
@@ -179,7 +201,7 @@ namespace ncore
                 binconfig_t(   16, c64KB),               binconfig_t(   16, c64KB),               // 14, 15
                 binconfig_t(   16, c64KB),               binconfig_t(   24, c64KB),               // 16, 17
                 binconfig_t(   24, c64KB),               binconfig_t(   24, c64KB),               // 18, 19
-                binconfig_t(   24, c64KB),               binconfig_t(   28, c64KB),               // 20, 21
+                binconfig_t(   24, c64KB),               binconfig_t(   32, c64KB),               // 20, 21
                 binconfig_t(   32, c64KB),               binconfig_t(   32, c64KB),               // 22, 23
                 binconfig_t(   32, c64KB),               binconfig_t(   40, c64KB),               // 24, 25
                 binconfig_t(   40, c64KB),               binconfig_t(   48, c64KB),               // 26, 27
@@ -254,31 +276,40 @@ namespace ncore
                 binconfig_t( 6*cMB, c32MB),             binconfig_t( 6*cMB + 512*cKB, c32MB),   // 164, 165
                 binconfig_t( 7*cMB, c32MB),             binconfig_t( 7*cMB + 512*cKB, c32MB),   // 166, 167
                 binconfig_t( 8*cMB, c32MB),             binconfig_t( 9*cMB, c32MB),             // 168, 169
-                binconfig_t( 10*cKB, c32MB),            binconfig_t( 11*cMB, c32MB),            // 170, 171
+                binconfig_t( 10*cMB, c32MB),            binconfig_t( 11*cMB, c32MB),            // 170, 171
                 binconfig_t( 12*cMB, c32MB),            binconfig_t( 13*cMB, c32MB),            // 172, 173
                 binconfig_t( 14*cMB, c32MB),            binconfig_t( 15*cMB, c32MB),            // 174, 175
                 binconfig_t( 16*cMB, c32MB),            binconfig_t( 18*cMB, c32MB),            // 176, 177
-                binconfig_t( 20*cKB, c32MB),            binconfig_t( 22*cMB, c32MB),            // 178, 179
+                binconfig_t( 20*cMB, c32MB),            binconfig_t( 22*cMB, c32MB),            // 178, 179
                 binconfig_t( 24*cMB, c32MB),            binconfig_t( 26*cMB, c32MB),            // 180, 181
-                binconfig_t( 28*cMB, c32MB),            binconfig_t( 30*cKB, c32MB),            // 182, 183
+                binconfig_t( 28*cMB, c32MB),            binconfig_t( 30*cMB, c32MB),            // 182, 183
                 binconfig_t( 32*cMB, c32MB),            binconfig_t( 36*cMB, c128MB),           // 184, 185
-                binconfig_t( 40*cKB, c128MB),           binconfig_t( 44*cMB, c128MB),           // 186, 187
+                binconfig_t( 40*cMB, c128MB),           binconfig_t( 44*cMB, c128MB),           // 186, 187
                 binconfig_t( 48*cMB, c128MB),           binconfig_t( 52*cMB, c128MB),           // 188, 189
-                binconfig_t( 56*cMB, c128MB),           binconfig_t( 60*cKB, c128MB),           // 190, 191
+                binconfig_t( 56*cMB, c128MB),           binconfig_t( 60*cMB, c128MB),           // 190, 191
                 binconfig_t( 64*cMB, c128MB),           binconfig_t( 72*cMB, c128MB),           // 192, 193
-                binconfig_t( 80*cKB, c128MB),           binconfig_t( 88*cMB, c128MB),           // 194, 195
+                binconfig_t( 80*cMB, c128MB),           binconfig_t( 88*cMB, c128MB),           // 194, 195
                 binconfig_t( 96*cMB, c128MB),           binconfig_t( 104*cMB, c128MB),          // 196, 197
                 binconfig_t( 112*cMB, c128MB),          binconfig_t( 120*cMB, c128MB),          // 198, 199
                 binconfig_t( 128*cMB, c128MB),          binconfig_t( 144*cMB, c512MB),          // 200, 201
                 binconfig_t( 160*cMB, c512MB),          binconfig_t( 176*cMB, c512MB),          // 202, 203
                 binconfig_t( 192*cMB, c512MB),          binconfig_t( 208*cMB, c512MB),          // 204, 205
-                binconfig_t( 224*cMB, c512MB),          binconfig_t( 240*cKB, c512MB),          // 206, 207
+                binconfig_t( 224*cMB, c512MB),          binconfig_t( 240*cMB, c512MB),          // 206, 207
                 binconfig_t( 256*cMB, c512MB),          binconfig_t( 288*cMB, c512MB),          // 208, 209
                 binconfig_t( 320*cMB, c512MB),          binconfig_t( 352*cMB, c512MB),          // 210, 211
                 binconfig_t( 384*cMB, c512MB),          binconfig_t( 416*cMB, c512MB),          // 212, 213
-                binconfig_t( 448*cMB, c512MB),          binconfig_t( 480*cKB, c512MB),          // 214, 215
+                binconfig_t( 448*cMB, c512MB),          binconfig_t( 480*cMB, c512MB),          // 214, 215
+                binconfig_t( 512*cMB, c512MB),                                                  // 216
+
+                // Aligned bins, a single element per chunk, one for each chunk config (see config_t::m_alignedbin_index)
+                binconfig_t(  64*cKB, c64KB),           binconfig_t( 128*cKB, c128KB),          // 217, 218
+                binconfig_t( 256*cKB, c256KB),          binconfig_t( 512*cKB, c512KB),          // 219, 220
+                binconfig_t(   2*cMB, c2MB),            binconfig_t(   8*cMB, c8MB),            // 221, 222
+                binconfig_t(  32*cMB, c32MB),           binconfig_t( 128*cMB, c128MB),          // 223, 224
+                binconfig_t( 512*cMB, c512MB),                                                  // 225
             };
-            static const s32 c_num_binconfigs = sizeof(c_abinconfigs) / sizeof(binconfig_t);
+            static const s32 c_num_binconfigs   = sizeof(c_abinconfigs) / sizeof(binconfig_t);
+            static const s32 c_alignedbin_index = c_num_binconfigs - c_num_chunkconfigs;
             // clang-format on
 
             // Note: It is preferable to analyze the memory usage of the application and adjust the superallocator configuration accordingly
@@ -312,6 +343,8 @@ namespace ncore
             const u32 c_internal_heap_pre_size      = 4 * cMB;
             const u32 c_internal_fsa_block_count    = 2048;
             const u32 c_internal_fsa_block_size     = 64 * cKB;
+            const u32 c_section_cache_count         = 1;
+            const u32 c_section_cache_time_ms       = 10000;
 
             nsuperalloc_config_10p::config_10p_t* config = &nsuperalloc_config_10p::s_config;
 
@@ -321,26 +354,258 @@ namespace ncore
             config->m_internal_heap_pre_size      = c_internal_heap_pre_size;
             config->m_internal_fsa_block_count    = c_internal_fsa_block_count;
             config->m_internal_fsa_block_size     = c_internal_fsa_block_size;
+            config->m_section_cache_count         = c_section_cache_count;
+            config->m_section_cache_time_ms       = c_section_cache_time_ms;
             config->m_section_minsize_shift       = sSectionSize_Min;
             config->m_section_maxsize_shift       = sSectionSize_Max;
             config->m_num_chunkconfigs            = c_num_chunkconfigs;
             config->m_num_binconfigs              = nsuperalloc_config_10p::c_num_binconfigs;
+            config->m_alignedbin_index            = nsuperalloc_config_10p::c_alignedbin_index;
             config->m_achunkconfigs               = c_achunkconfigs;
             config->m_abinconfigs                 = nsuperalloc_config_10p::c_abinconfigs;
+            config->setup_small_size2bin();
 
 #ifdef SUPERALLOC_DEBUG
-            // sanity check the configuration
-            for (s16 s = 0; s < config->m_num_binconfigs; s++)
+            ASSERT(gConfigValidate(config));  // sanity check the configuration
+#endif
+            return config;
+        }
+
+        /// ---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+        /// Validation of a configuration, used by the sanity checks of the fixed configurations and by gConfigCompute.
+
+        bool gConfigValidate(config_t const* config)
+        {
+            if (config->m_num_binconfigs > 256)  // Bin indices are u8
+                return false;
+            if (config->m_alignedbin_index + config->m_num_chunkconfigs != config->m_num_binconfigs)
+                return false;
+
+            for (s16 c = 0; c < config->m_num_chunkconfigs; c++)
             {
-                u32 const          size      = config->m_abinconfigs[s].m_alloc_size;
-                u8 const           bin_index = config->size2bin(size);
-                binconfig_t const& bin       = config->m_abinconfigs[bin_index];
-                ASSERT(size <= bin.m_alloc_size);
-                ASSERT(bin.m_max_alloc_count >= 1);     // Zero is not allowed
-                ASSERT(bin.m_max_alloc_count <= 4096);  // The binmap we use can only handle max 4096 bits
+                chunkconfig_t const& chunk_config = config->m_achunkconfigs[c];
+                if (chunk_config.m_chunkconfig_index != c)
+                    return false;
+                if (c > 0 && chunk_config.m_sizeshift <= config->m_achunkconfigs[c - 1].m_sizeshift)
+                    return false;
+                if (chunk_config.m_sizeshift > chunk_config.m_section_sizeshift || chunk_config.m_section_sizeshift < config->m_section_minsize_shift || chunk_config.m_section_sizeshift > config->m_section_maxsize_shift)
+                    return false;
+            }
+
+            for (s16 s = 0; s < config->m_alignedbin_index; s++)
+            {
+                binconfig_t const& bin = config->m_abinconfigs[s];
+                if (bin.m_max_alloc_count < 1 || bin.m_max_alloc_count > 4096)  // The binmap we use can only handle max 4096 bits
+                    return false;
+                if (bin.m_chunk_config.m_sizeshift > 29)  // Limit of the offset_to_index reciprocal
+                    return false;
+                if (s > 0 && bin.m_alloc_size < config->m_abinconfigs[s - 1].m_alloc_size)
+                    return false;
+
+                u8 const bin_index = config->size2bin(bin.m_alloc_size);
+                if (bin_index >= config->m_alignedbin_index || bin.m_alloc_size > config->m_abinconfigs[bin_index].m_alloc_size)
+                    return false;
+
+                for (u32 e = 0; e < bin.m_max_alloc_count; e++)
+                {
+                    u64 const offset = (u64)e * bin.m_alloc_size;
+                    if (bin.offset_to_index(offset) != e || bin.offset_to_index(offset + bin.m_alloc_size - 1) != e)
+                        return false;
+                }
+            }
+
+            // The small size table must agree with size2bin on the size of the bin
+            for (u32 size = 8; size <= config_t::cSmallSizeMax; size++)
+            {
+                if (config->m_abinconfigs[config->size2bin_fast(size)].m_alloc_size != config->m_abinconfigs[config->size2bin(size)].m_alloc_size)
+                    return false;
+            }
+
+            // A bin resolved at compile time by nconfig25p::size2bin must be a bin of the same size as the bin of size2bin
+            if (config->m_static_size2bin && config->m_alignedbin_index > 0)
+            {
+                u32 const max_size = config->m_abinconfigs[config->m_alignedbin_index - 1].m_alloc_size;
+                for (u32 size = 1; size <= max_size; size++)
+                {
+                    u8 const bin_index = nconfig25p::size2bin(size);
+                    if (bin_index >= config->m_alignedbin_index || config->m_abinconfigs[bin_index].m_alloc_size != config->m_abinconfigs[config->size2bin_fast(size)].m_alloc_size)
+                        return false;
+                }
+            }
+
+            for (s16 c = 0; c < config->m_num_chunkconfigs; c++)
+            {
+                binconfig_t const& bin = config->m_abinconfigs[config->m_alignedbin_index + c];
+                if (bin.m_chunk_config.m_chunkconfig_index != c || bin.m_max_alloc_count != 1)
+                    return false;
+            }
+            return true;
+        }
+
+        /// ---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+        /// Computing a configuration at init time, a port of docs/compute_bins.go.
+        ///
+        /// The bins follow the layout of the fixed configurations, 2^k bins for every power-of-two (k = 2 for the
+        /// 25% config, k = 3 for the 10% config), so that size2bin stays a few bit operations. Rounding a size up
+        /// to its bin wastes at most 1/2^k of the size, k is the smallest that meets the waste target as long as
+        /// the number of bins can still be addressed by a u8 bin index.
+
+        namespace nsuperalloc_config_gen
+        {
+            class config_gen_t : public config_t
+            {
+            public:
+                config_gen_t(s8 subbin_shift)
+                    : m_subbin_shift(subbin_shift)
+                {
+                }
+
+                DCORE_CLASS_PLACEMENT_NEW_DELETE
+
+                u8 size2bin(u32 alloc_size) const override final
+                {
+                    alloc_size    = math::max(alloc_size, (u32)1 << m_subbin_shift);
+                    const s32 s   = 31 - m_subbin_shift;
+                    const s32 w   = math::countLeadingZeros(alloc_size);
+                    const u32 f   = (u32)0x80000000 >> w;
+                    const u32 t   = ((f - 1) >> m_subbin_shift);
+                    alloc_size    = (alloc_size + t) & ~t;
+                    const s32 bin = (s32)(alloc_size >> (s - w)) + ((s - w) << m_subbin_shift);
+                    ASSERT(alloc_size <= m_abinconfigs[bin].m_alloc_size);
+                    return (u8)bin;
+                }
+
+                s8 m_subbin_shift;
+            };
+
+            // binconfig_t has const members, the computed bins are constructed in place
+            struct binconfig_gen_t : public binconfig_t
+            {
+                binconfig_gen_t(u32 alloc_size, chunkconfig_t const& chunk_config)
+                    : binconfig_t(alloc_size, chunk_config)
+                {
+                }
+
+                DCORE_CLASS_PLACEMENT_NEW_DELETE
+            };
+
+            // The largest size that maps to 'bin', the inverse of config_gen_t::size2bin
+            static u64 s_bin_to_size(s32 bin, s8 subbin_shift)
+            {
+                s32 const shift = (bin >> subbin_shift) - 1;
+                if (shift < 0)
+                    return 0;
+                return (u64)((1 << subbin_shift) + (bin & ((1 << subbin_shift) - 1))) << shift;
+            }
+
+            // Number of bins needed to reach a size of 2^max_sizeshift
+            static s32 s_num_bins(s8 max_sizeshift, s8 subbin_shift) { return ((max_sizeshift - subbin_shift + 1) << subbin_shift) + 1; }
+
+            // Sizes from here on take the smallest chunk config they fit in, a chunk of these is committed as a
+            // whole (all its elements) so holding many of them per chunk would commit a lot of memory up front.
+            static const u32 c_large_alloc_size = 128 * cKB;
+
+            // The smallest chunk config that holds at least 'm_min_alloc_count' elements and where the unused part
+            // of the last committed page stays within the waste target. When no chunk config meets both, the one
+            // with the least waste is taken. The element count is capped by the 4096 bits of the binmap.
+            static s16 s_compute_chunkconfig(configgen_t const& params, chunkconfig_t const* chunkconfigs, s16 num_chunkconfigs, u32 alloc_size)
+            {
+                s16 fallback       = -1;
+                u64 fallback_waste = 0;
+                for (s16 c = 0; c < num_chunkconfigs; c++)
+                {
+                    u64 const chunk_size = (u64)1 << chunkconfigs[c].m_sizeshift;
+                    if (chunk_size < alloc_size || (chunk_size & (params.m_page_size - 1)) != 0)
+                        continue;
+                    if (alloc_size >= c_large_alloc_size)
+                        return c;
+
+                    u64 const count     = math::min(chunk_size / alloc_size, (u64)4096);
+                    u64 const used      = count * alloc_size;
+                    u64 const committed = (used + params.m_page_size - 1) & ~((u64)params.m_page_size - 1);
+                    u64 const waste     = ((committed - used) * 10000) / used;  // 1/100th of a percent
+                    if (waste <= (u64)params.m_waste_percentage * 100 && count >= params.m_min_alloc_count)
+                        return c;
+                    if (fallback < 0 || waste < fallback_waste)
+                    {
+                        fallback       = c;
+                        fallback_waste = waste;
+                    }
+                }
+                return fallback;
+            }
+        }  // namespace nsuperalloc_config_gen
+
+        config_t const* gConfigCompute(alloc_t* heap, configgen_t const& params)
+        {
+            using namespace nsuperalloc_config_gen;
+
+            chunkconfig_t const* chunkconfigs     = (params.m_achunkconfigs != nullptr) ? params.m_achunkconfigs : c_achunkconfigs;
+            s16 const            num_chunkconfigs = (params.m_achunkconfigs != nullptr) ? params.m_num_chunkconfigs : (s16)c_num_chunkconfigs;
+            config_t const*      base             = (params.m_base != nullptr) ? params.m_base : gConfigWindowsDesktopApp25p();
+            if (num_chunkconfigs <= 0 || !math::ispo2(params.m_page_size) || !math::ispo2(params.m_alloc_align) || params.m_alloc_align < 8)
+                return nullptr;
+
+            // The largest bin holds a whole chunk of the largest chunk config
+            s8 const max_sizeshift = chunkconfigs[num_chunkconfigs - 1].m_sizeshift;
+            s8       subbin_shift  = 0;
+            while (subbin_shift < 4 && (100u >> subbin_shift) > params.m_waste_percentage)
+                subbin_shift += 1;
+            while (subbin_shift > 0 && (s_num_bins(max_sizeshift, subbin_shift) + num_chunkconfigs) > 256)
+                subbin_shift -= 1;
+
+            s32 const num_bins       = s_num_bins(max_sizeshift, subbin_shift);
+            s32 const num_binconfigs = num_bins + num_chunkconfigs;
+            if (num_binconfigs > 256)
+                return nullptr;
+
+            binconfig_t* binconfigs = (binconfig_t*)heap->allocate(sizeof(binconfig_t) * num_binconfigs);
+            for (s32 b = 0; b < num_bins; b++)
+            {
+                u64 const size  = math::max((s_bin_to_size(b, subbin_shift) + (params.m_alloc_align - 1)) & ~((u64)params.m_alloc_align - 1), (u64)params.m_alloc_align);
+                s16 const chunk = s_compute_chunkconfig(params, chunkconfigs, num_chunkconfigs, (u32)size);
+                if (chunk < 0)
+                {
+                    heap->deallocate(binconfigs);
+                    return nullptr;
+                }
+                new (&binconfigs[b]) binconfig_gen_t((u32)size, chunkconfigs[chunk]);
+            }
+            for (s16 c = 0; c < num_chunkconfigs; c++)
+                new (&binconfigs[num_bins + c]) binconfig_gen_t((u32)1 << chunkconfigs[c].m_sizeshift, chunkconfigs[c]);
+
+            config_gen_t* config = new (heap->allocate(sizeof(config_gen_t))) config_gen_t(subbin_shift);
+
+            config->m_total_address_size          = base->m_total_address_size;
+            config->m_section_address_range       = base->m_section_address_range;
+            config->m_internal_heap_address_range = base->m_internal_heap_address_range;
+            config->m_internal_heap_pre_size      = base->m_internal_heap_pre_size;
+            config->m_internal_fsa_block_count    = base->m_internal_fsa_block_count;
+            config->m_internal_fsa_block_size     = base->m_internal_fsa_block_size;
+            config->m_section_cache_count         = base->m_section_cache_count;
+            config->m_section_cache_time_ms       = base->m_section_cache_time_ms;
+            config->m_section_minsize_shift       = base->m_section_minsize_shift;
+            config->m_section_maxsize_shift       = base->m_section_maxsize_shift;
+            config->m_num_chunkconfigs            = num_chunkconfigs;
+            config->m_num_binconfigs              = (s16)num_binconfigs;
+            config->m_alignedbin_index            = (s16)num_bins;
+            config->m_achunkconfigs               = chunkconfigs;
+            config->m_abinconfigs                 = binconfigs;
+            config->setup_small_size2bin();
+
+            if (!gConfigValidate(config))
+            {
+                gConfigDestroy(heap, config);
+                return nullptr;
             }
-#endif
             return config;
         }
+
+        void gConfigDestroy(alloc_t* heap, config_t const* config)
+        {
+            nsuperalloc_config_gen::config_gen_t* gen = (nsuperalloc_config_gen::config_gen_t*)config;
+            heap->deallocate((void*)gen->m_abinconfigs);
+            g_destruct(heap, gen);
+        }
     }  // namespace nsuperalloc
 }  // namespace ncore
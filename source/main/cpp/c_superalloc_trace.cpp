@@ -0,0 +1,512 @@
+#include "ccore/c_target.h"
+#include "ccore/c_allocator.h"
+#include "ccore/c_debug.h"
+#include "ccore/c_math.h"
+#include "ccore/c_memory.h"
+
+#include "csuperalloc/private/c_multithread.h"
+#include "csuperalloc/private/c_platform.h"
+#include "csuperalloc/c_superalloc.h"
+#include "csuperalloc/c_superalloc_trace.h"
+
+namespace ncore
+{
+    namespace nsuperalloc
+    {
+        // Live allocations of a trace, pointer -> (record index, requested size), open addressing with
+        // linear probing and backward shift deletion (no tombstones).
+        struct trace_map_t
+        {
+            struct entry_t
+            {
+                void* m_ptr;
+                u32   m_record;
+                u32   m_size;
+            };
+
+            entry_t* m_entries;
+            u32      m_count;
+            u32      m_mask;
+
+            static inline u32 s_hash(void* ptr) { return (u32)((((u64)ptr) * 0x9E3779B97F4A7C15ull) >> 32); }
+
+            void initialize(alloc_t* heap, u32 capacity)
+            {
+                m_entries = g_allocate_array<entry_t>(heap, capacity);
+                nmem::memset(m_entries, 0, sizeof(entry_t) * capacity);
+                m_count = 0;
+                m_mask  = capacity - 1;
+            }
+
+            void deinitialize(alloc_t* heap)
+            {
+                g_deallocate_array(heap, m_entries);
+                m_entries = nullptr;
+            }
+
+            void insert(alloc_t* heap, void* ptr, u32 record, u32 size)
+            {
+                if (((m_count + 1) * 4) > ((m_mask + 1) * 3))
+                {
+                    entry_t* const old_entries  = m_entries;
+                    u32 const      old_capacity = m_mask + 1;
+                    initialize(heap, old_capacity * 2);
+                    for (u32 i = 0; i < old_capacity; ++i)
+                    {
+                        if (old_entries[i].m_ptr != nullptr)
+                            insert(heap, old_entries[i].m_ptr, old_entries[i].m_record, old_entries[i].m_size);
+                    }
+                    g_deallocate_array(heap, old_entries);
+                }
+
+                u32 i = s_hash(ptr) & m_mask;
+                while (m_entries[i].m_ptr != nullptr && m_entries[i].m_ptr != ptr)
+                    i = (i + 1) & m_mask;
+                if (m_entries[i].m_ptr == nullptr)
+                    m_count += 1;
+                m_entries[i].m_ptr    = ptr;
+                m_entries[i].m_record = record;
+                m_entries[i].m_size   = size;
+            }
+
+            bool remove(void* ptr, u32& record, u32& size)
+            {
+                u32 i = s_hash(ptr) & m_mask;
+                while (m_entries[i].m_ptr != ptr)
+                {
+                    if (m_entries[i].m_ptr == nullptr)
+                        return false;
+                    i = (i + 1) & m_mask;
+                }
+                record = m_entries[i].m_record;
+                size   = m_entries[i].m_size;
+
+                // Shift back the entries that follow until an empty slot or an entry that is at its home slot
+                u32 j = i;
+                while (true)
+                {
+                    j = (j + 1) & m_mask;
+                    if (m_entries[j].m_ptr == nullptr)
+                        break;
+                    u32 const home = s_hash(m_entries[j].m_ptr) & m_mask;
+                    if (((j - home) & m_mask) >= ((j - i) & m_mask))
+                    {
+                        m_entries[i] = m_entries[j];
+                        i            = j;
+                    }
+                }
+                m_entries[i].m_ptr = nullptr;
+                m_count -= 1;
+                return true;
+            }
+        };
+
+        struct trace_t
+        {
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+
+            enum
+            {
+                cBufferRecords = 64 * 1024,  // Record pairs that are buffered before they are written to the file
+            };
+
+            alloc_t*    m_heap;
+            void*       m_file;         // nullptr = in-memory trace
+            s32*        m_records;      // Buffered record pairs (in-memory: all record pairs)
+            u32         m_buffered;     // Number of record pairs in m_records
+            u32         m_capacity;     // Capacity of m_records in record pairs
+            u32         m_num_records;  // Number of record pairs in the trace (written and buffered)
+            s32         m_thread;       // Thread index of the last thread switch record, -1 = none yet
+            trace_map_t m_live;
+            spinlock_t  m_lock;
+
+            void flush()
+            {
+                if (m_file != nullptr && m_buffered > 0)
+                {
+                    nplatform::file_write(m_file, m_records, (u64)m_buffered * 2 * sizeof(s32));
+                    m_buffered = 0;
+                }
+            }
+
+            void append(s32 w0, s32 w1)
+            {
+                if (m_buffered == m_capacity)
+                {
+                    if (m_file != nullptr)
+                    {
+                        flush();
+                    }
+                    else
+                    {
+                        s32* const records = g_allocate_array<s32>(m_heap, m_capacity * 2 * 2);
+                        nmem::memcpy(records, m_records, (int_t)m_buffered * 2 * sizeof(s32));
+                        g_deallocate_array(m_heap, m_records);
+                        m_records = records;
+                        m_capacity *= 2;
+                    }
+                }
+                m_records[m_buffered * 2 + 0] = w0;
+                m_records[m_buffered * 2 + 1] = w1;
+                m_buffered += 1;
+                m_num_records += 1;
+            }
+
+            void switch_thread(s16 thread_index)
+            {
+                if (m_thread != thread_index)
+                {
+                    append(cTraceThread, thread_index);
+                    m_thread = thread_index;
+                }
+            }
+
+            void record_alloc(s16 thread_index, void* ptr, u32 size)
+            {
+                if (ptr == nullptr)
+                    return;
+                ASSERT(size > 0 && size < (u32)0x80000000);
+                scoped_spinlock_t lock(m_lock);
+                switch_thread(thread_index);
+                m_live.insert(m_heap, ptr, m_num_records, size);
+                append((s32)size, 0);
+            }
+
+            // Must be called before the memory is actually freed, otherwise the address could be handed out and
+            // recorded by another thread before the free is recorded.
+            void record_free(s16 thread_index, void* ptr)
+            {
+                if (ptr == nullptr)
+                    return;
+                scoped_spinlock_t lock(m_lock);
+                u32               record, size;
+                if (!m_live.remove(ptr, record, size))
+                    return;
+                switch_thread(thread_index);
+                append(-(s32)size, (s32)record);
+            }
+
+            // Reallocates under the lock, so that a moved block cannot be handed out and recorded by another thread
+            // before its free is recorded. A failed reallocation (nullptr for a non-zero size) records nothing.
+            void* record_reallocate(s16 thread_index, vmalloc_t* allocator, void* ptr, u32 new_size, u32 alignment)
+            {
+                ASSERT(new_size < (u32)0x80000000);
+                scoped_spinlock_t lock(m_lock);
+                void* const       new_ptr = allocator->reallocate(ptr, new_size, alignment);
+                if (new_ptr == nullptr && new_size > 0)
+                    return nullptr;
+
+                u32 record, size;
+                if (ptr != nullptr && m_live.remove(ptr, record, size))
+                {
+                    switch_thread(thread_index);
+                    append(-(s32)size, (s32)record);
+                }
+                if (new_ptr != nullptr)
+                {
+                    switch_thread(thread_index);
+                    m_live.insert(m_heap, new_ptr, m_num_records, new_size);
+                    append((s32)new_size, 0);
+                }
+                return new_ptr;
+            }
+        };
+
+        trace_t* gCreateTrace(alloc_t* heap, char const* filepath)
+        {
+            void* file = nullptr;
+            if (filepath != nullptr)
+            {
+                file = nplatform::file_open_write(filepath);
+                if (file == nullptr)
+                    return nullptr;
+            }
+
+            trace_t* trace       = new (heap->allocate(sizeof(trace_t))) trace_t();
+            trace->m_heap        = heap;
+            trace->m_file        = file;
+            trace->m_capacity    = trace_t::cBufferRecords;
+            trace->m_records     = g_allocate_array<s32>(heap, trace->m_capacity * 2);
+            trace->m_buffered    = 0;
+            trace->m_num_records = 0;
+            trace->m_thread      = -1;
+            trace->m_live.initialize(heap, 4096);
+            trace->m_lock.initialize();
+            return trace;
+        }
+
+        void gDestroyTrace(trace_t* trace)
+        {
+            alloc_t* heap = trace->m_heap;
+            if (trace->m_file != nullptr)
+            {
+                trace->flush();
+                nplatform::file_close(trace->m_file);
+            }
+            trace->m_live.deinitialize(heap);
+            g_deallocate_array(heap, trace->m_records);
+            g_destruct(heap, trace);
+        }
+
+        s32 const* gTraceRecords(trace_t* trace, u32& num_records)
+        {
+            ASSERT(trace->m_file == nullptr);  // Only an in-memory trace has all its records available
+            num_records = trace->m_buffered;
+            return trace->m_records;
+        }
+
+        // --------------------------------------------------------------------------------------------
+        // Recording allocator
+
+        class recorder_t : public vmalloc_t
+        {
+        public:
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+
+            recorder_t(trace_t* trace, vmalloc_t* allocator, s16 thread_index)
+                : m_trace(trace)
+                , m_allocator(allocator)
+                , m_thread_index(thread_index)
+            {
+            }
+
+            trace_t*   m_trace;
+            vmalloc_t* m_allocator;
+            s16        m_thread_index;
+
+        protected:
+            virtual void* v_allocate(u32 size, u32 alignment)
+            {
+                void* ptr = m_allocator->allocate(size, alignment);
+                m_trace->record_alloc(m_thread_index, ptr, size);
+                return ptr;
+            }
+
+            virtual void* v_allocate_hinted(u32 size, u32 alignment, lifetime_t hint)
+            {
+                void* ptr = m_allocator->allocate(size, alignment, hint);
+                m_trace->record_alloc(m_thread_index, ptr, size);
+                return ptr;
+            }
+
+            virtual void v_deallocate(void* ptr)
+            {
+                m_trace->record_free(m_thread_index, ptr);
+                m_allocator->deallocate(ptr);
+            }
+
+            virtual void* v_reallocate(void* ptr, u32 new_size, u32 alignment)
+            {
+                return m_trace->record_reallocate(m_thread_index, m_allocator, ptr, new_size, alignment);
+            }
+
+            virtual void* v_allocate_bin(u8 bin_index, u32 size, u32 alignment)
+            {
+                void* ptr = m_allocator->allocate_bin(bin_index, size, alignment);
+                m_trace->record_alloc(m_thread_index, ptr, size);
+                return ptr;
+            }
+
+            virtual u32 v_allocate_n(u32 size, u32 alignment, void** out, u32 count)
+            {
+                u32 const n = m_allocator->allocate_n(size, alignment, out, count);
+                for (u32 i = 0; i < n; ++i)
+                    m_trace->record_alloc(m_thread_index, out[i], size);
+                return n;
+            }
+
+            virtual void v_deallocate_n(void** ptrs, u32 count)
+            {
+                for (u32 i = 0; i < count; ++i)
+                    m_trace->record_free(m_thread_index, ptrs[i]);
+                m_allocator->deallocate_n(ptrs, count);
+            }
+
+            virtual void v_release() { m_allocator->release(); }
+
+            virtual u32  v_get_size(void* ptr) const { return m_allocator->get_size(ptr); }
+            virtual void v_set_tag(void* ptr, u32 assoc) { m_allocator->set_tag(ptr, assoc); }
+            virtual u32  v_get_tag(void* ptr) const { return m_allocator->get_tag(ptr); }
+            virtual void v_get_stats(stats_t& stats) const { m_allocator->get_stats(stats); }
+            virtual void v_record_sizes(bool enable) { m_allocator->record_sizes(enable); }
+            virtual void v_analyze(fragmentation_t& report) const { m_allocator->analyze(report); }
+            virtual void v_visit(visit_fn fn, void* user) const { m_allocator->visit(fn, user); }
+            virtual u64  v_trim(u64 target_bytes) { return m_allocator->trim(target_bytes); }
+            virtual void v_set_pressure_source(pressure_fn fn, void* user, u32 interval_ms) { m_allocator->set_pressure_source(fn, user, interval_ms); }
+        };
+
+        vmalloc_t* gCreateRecordingAllocator(trace_t* trace, vmalloc_t* allocator, s16 thread_index)
+        {
+            return new (trace->m_heap->allocate(sizeof(recorder_t))) recorder_t(trace, allocator, thread_index);
+        }
+
+        void gDestroyRecordingAllocator(vmalloc_t* recorder)
+        {
+            recorder_t* r = static_cast<recorder_t*>(recorder);
+            g_destruct(r->m_trace->m_heap, r);
+        }
+
+        // --------------------------------------------------------------------------------------------
+        // Replay
+
+        // Log-linear latency histogram, 8 buckets per power of two
+        static const u32 c_latency_buckets = 512;
+
+        static inline u32 s_latency_bucket(u64 ns)
+        {
+            if (ns < 8)
+                return (u32)ns;
+            s8 const msb = 63 - math::countLeadingZeros(ns);
+            return ((u32)(msb - 2) * 8) + (u32)((ns >> (msb - 3)) & 7);
+        }
+
+        static inline u64 s_latency_bucket_upper(u32 bucket)
+        {
+            if (bucket < 8)
+                return bucket;
+            s8 const  msb   = (s8)(bucket / 8) + 2;
+            u64 const lower = (u64)(8 + (bucket & 7)) << (msb - 3);
+            return lower + ((u64)1 << (msb - 3)) - 1;
+        }
+
+        static u64 s_latency_percentile(u64 const* histogram, u64 count, u64 permille)
+        {
+            if (count == 0)
+                return 0;
+            u64 const rank = ((count * permille) + 999) / 1000;
+            u64       sum  = 0;
+            for (u32 i = 0; i < c_latency_buckets; ++i)
+            {
+                sum += histogram[i];
+                if (sum >= rank)
+                    return s_latency_bucket_upper(i);
+            }
+            return s_latency_bucket_upper(c_latency_buckets - 1);
+        }
+
+        f64 replay_stats_t::peak_fragmentation() const
+        {
+            f64 const committed = (f64)m_peak_committed_pages * (f64)m_page_size;
+            return committed > 0.0 ? (committed - (f64)m_peak_live_bytes) / committed : 0.0;
+        }
+
+        f64 replay_stats_t::final_fragmentation() const
+        {
+            f64 const committed = (f64)m_final_committed_pages * (f64)m_page_size;
+            return committed > 0.0 ? (committed - (f64)m_final_live_bytes) / committed : 0.0;
+        }
+
+        bool gReplayTrace(alloc_t* heap, vmalloc_t** allocators, u32 num_allocators, s32 const* records, u32 num_records, replay_stats_t& result)
+        {
+            nmem::memset(&result, 0, sizeof(result));
+            if (num_allocators == 0 || num_records > (0xffffffffu / sizeof(void*)))
+                return false;
+
+            // Committed pages are sampled every 'c_sample_interval' operations, get_stats is not cheap
+            static const u32 c_sample_interval = 1024;
+
+            void** ptrs = g_allocate_array<void*>(heap, num_records);
+            nmem::memset(ptrs, 0, (int_t)num_records * sizeof(void*));
+            u64* histogram = g_allocate_array<u64>(heap, replay_stats_t::cOpTypes * c_latency_buckets);
+            nmem::memset(histogram, 0, replay_stats_t::cOpTypes * c_latency_buckets * sizeof(u64));
+            stats_t* stats = g_allocate<stats_t>(heap);
+
+            vmalloc_t* allocator  = allocators[0];
+            u64        live_bytes = 0;
+            u64        ops        = 0;
+            bool       valid      = true;
+            for (u32 i = 0; i < num_records; ++i)
+            {
+                s32 const w0 = records[i * 2 + 0];
+                s32 const w1 = records[i * 2 + 1];
+                if (w0 == cTraceThread)
+                {
+                    allocator = allocators[(u32)w1 % num_allocators];
+                    continue;
+                }
+
+                if (w0 > 0)
+                {
+                    u64 const begin = nplatform::time_ns();
+                    void*     ptr   = allocator->allocate((u32)w0);
+                    u64 const ns    = nplatform::time_ns() - begin;
+                    histogram[(replay_stats_t::cAlloc * c_latency_buckets) + s_latency_bucket(ns)] += 1;
+                    result.m_ops[replay_stats_t::cAlloc] += 1;
+                    result.m_total_ns += ns;
+                    if (ptr == nullptr)
+                    {
+                        result.m_failed_allocs += 1;
+                    }
+                    else
+                    {
+                        live_bytes += (u32)w0;
+                        ptrs[i] = ptr;
+                    }
+                }
+                else if (w0 < 0 && (u32)w1 < i)
+                {
+                    void* ptr = ptrs[w1];
+                    if (ptr == nullptr)  // The allocation failed during replay
+                        continue;
+                    ptrs[w1]        = nullptr;
+                    u64 const begin = nplatform::time_ns();
+                    allocator->deallocate(ptr);
+                    u64 const ns = nplatform::time_ns() - begin;
+                    histogram[(replay_stats_t::cFree * c_latency_buckets) + s_latency_bucket(ns)] += 1;
+                    result.m_ops[replay_stats_t::cFree] += 1;
+                    result.m_total_ns += ns;
+                    live_bytes -= (u32)(-w0);
+                }
+                else
+                {
+                    valid = false;
+                    break;
+                }
+
+                ops += 1;
+                if ((ops % c_sample_interval) == 0)
+                {
+                    allocators[0]->get_stats(*stats);
+                    if (stats->m_committed_pages > result.m_peak_committed_pages)
+                    {
+                        result.m_peak_committed_pages = stats->m_committed_pages;
+                        result.m_peak_live_bytes      = live_bytes;
+                    }
+                }
+            }
+
+            allocators[0]->get_stats(*stats);
+            result.m_page_size             = stats->m_page_size;
+            result.m_final_committed_pages = stats->m_committed_pages;
+            result.m_final_live_bytes      = live_bytes;
+            if (stats->m_committed_pages > result.m_peak_committed_pages)
+            {
+                result.m_peak_committed_pages = stats->m_committed_pages;
+                result.m_peak_live_bytes      = live_bytes;
+            }
+
+            for (u32 op = 0; op < replay_stats_t::cOpTypes; ++op)
+            {
+                u64 const* h         = histogram + (op * c_latency_buckets);
+                result.m_p50_ns[op]  = s_latency_percentile(h, result.m_ops[op], 500);
+                result.m_p99_ns[op]  = s_latency_percentile(h, result.m_ops[op], 990);
+                result.m_p999_ns[op] = s_latency_percentile(h, result.m_ops[op], 999);
+            }
+            u64 const total_ops  = result.m_ops[replay_stats_t::cAlloc] + result.m_ops[replay_stats_t::cFree];
+            result.m_ops_per_sec = result.m_total_ns > 0 ? (u64)(((f64)total_ops * 1000000000.0) / (f64)result.m_total_ns) : 0;
+
+            // Free what the trace left alive
+            for (u32 i = 0; i < num_records; ++i)
+            {
+                if (ptrs[i] != nullptr)
+                    allocators[0]->deallocate(ptrs[i]);
+            }
+
+            g_deallocate(heap, stats);
+            g_deallocate_array(heap, histogram);
+            g_deallocate_array(heap, ptrs);
+            return valid;
+        }
+
+    }  // namespace nsuperalloc
+}  // namespace ncore
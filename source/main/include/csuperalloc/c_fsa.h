@@ -18,6 +18,7 @@ namespace ncore
         void*  allocate(fsa_t* fsa, u32 size);
         void   deallocate(fsa_t* fsa, void* ptr);
         u32    get_size(fsa_t* fsa, void* ptr);
+        u64    get_used_size(fsa_t* fsa);  // committed size of the blocks that are in use
         u32    ptr2idx(fsa_t* fsa, void* ptr);
         void*  idx2ptr(fsa_t* fsa, u32 index);
     }  // namespace nfsa
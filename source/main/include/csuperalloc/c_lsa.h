@@ -39,6 +39,7 @@ namespace ncore
         void   destroy(lsa_t* lsa);
         void*  allocate(lsa_t* lsa, u32 size);
         void   deallocate(lsa_t* lsa, void* ptr);
+        void*  reallocate(lsa_t* lsa, void* ptr, u32 new_size);  // in place, returns nullptr (ptr untouched) when new_size exceeds the block size or cannot be committed
         u32    get_size(lsa_t* lsa, void* ptr);
     }  // namespace nlsa
 
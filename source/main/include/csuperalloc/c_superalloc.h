@@ -6,6 +6,7 @@
 #endif
 
 #include "cbase/c_allocator.h"
+#include "csuperalloc/c_superalloc_config.h"
 
 namespace ncore
 {
@@ -14,8 +15,228 @@ namespace ncore
 
     namespace nsuperalloc
     {
+        // Statistics of a chunk config (chunk size)
+        struct chunkconfig_stats_t
+        {
+            u64 m_chunk_size;         // The size of a chunk in bytes
+            u32 m_chunks_used;        // Number of chunks that hold elements (active and full, all allocator instances)
+            u32 m_chunks_cached;      // Number of empty chunks that are kept committed
+            u32 m_chunks_cached_max;  // Maximum number of chunks that can be cached (1 << chunkconfig_t::m_cacheshift)
+            u32 m_cached_pages;       // Number of committed pages held by the cached chunks
+            u32 m_committed_pages;    // Number of committed pages held by all chunks (used and cached)
+            u32 m_sections_used;      // Number of sections that hold used or cached chunks
+            u32 m_sections_cached;    // Number of empty sections that are kept for reuse
+            u32 m_padding;
+        };
+
+        // Statistics of a bin (allocation size), these are per allocator instance
+        struct bin_stats_t
+        {
+            u32 m_alloc_size;     // The size of an element of this bin
+            u32 m_elements_used;  // Number of live elements
+            u32 m_chunks_active;  // Number of chunks that have used and free elements
+            u32 m_chunks_full;    // Number of chunks that have no free elements
+        };
+
+        // A snapshot of the state of the allocator
+        struct stats_t
+        {
+            enum
+            {
+                cMaxChunkConfigs = 32,
+                cMaxBinConfigs   = 256,
+            };
+
+            u32                 m_page_size;           // Size of a page in bytes
+            u32                 m_committed_pages;     // Number of pages currently committed for user memory
+            u32                 m_num_chunkconfigs;    // Number of valid entries in m_chunkconfigs
+            u32                 m_num_binconfigs;      // Number of valid entries in m_bins
+            u32                 m_aligned_count;       // Number of allocations that live in a dedicated (aligned) chunk
+            u32                 m_aligned_pages;       // Number of pages committed for those allocations
+            u64                 m_aligned_waste;       // Bytes of address space of those chunks that are not committed (the cost of the alignment)
+            u64                 m_internal_fsa_size;   // Bytes committed by the internal fsa(s) for book-keeping (chunks, sections, tags)
+            chunkconfig_stats_t m_chunkconfigs[cMaxChunkConfigs];
+            bin_stats_t         m_bins[cMaxBinConfigs];
+        };
+
+        // Fragmentation of a bin, over all the chunks of this bin (all allocator instances)
+        struct bin_fragmentation_t
+        {
+            u32 m_alloc_size;         // The size of an element of this bin (aligned bins: the chunk size)
+            u32 m_chunks;             // Number of chunks that hold elements
+            u64 m_elements_used;      // Number of live elements
+            u64 m_elements_free;      // Number of free elements in those chunks
+            u64 m_elements_recorded;  // Number of live elements that have a recorded requested size (see vmalloc_t::record_sizes)
+            u64 m_requested_bytes;    // Sum of the requested sizes of those elements
+            u64 m_committed_bytes;    // Bytes committed by the chunks of this bin
+        };
+
+        // Fragmentation of a section (an address range dedicated to a single chunk size)
+        struct section_fragmentation_t
+        {
+            u64 m_address_offset;   // Offset of the section in the address space of the allocator
+            u64 m_size;             // Size of the section in bytes
+            u64 m_chunk_size;       // Size of a chunk in this section
+            u32 m_chunks_max;       // Number of chunks that fit in this section
+            u32 m_chunks_used;      // Number of chunks that hold elements
+            u32 m_chunks_cached;    // Number of empty chunks that are kept committed
+            u32 m_committed_pages;  // Pages committed by the used and cached chunks
+            u32 m_cached_pages;     // Pages committed by the cached chunks
+            u32 m_padding;
+            u64 m_unused_address;   // Bytes of the section that are not committed
+        };
+
+        // Where the committed memory goes, a walk over all sections, chunks and elements (see vmalloc_t::analyze)
+        // committed = used + free elements + cached + the tail of the last page of the chunks (not reported)
+        struct fragmentation_t
+        {
+            enum
+            {
+                cMaxBinConfigs = 256,
+                cMaxSections   = 256,
+            };
+
+            u32                     m_page_size;            // Size of a page in bytes
+            u32                     m_num_binconfigs;       // Number of valid entries in m_bins
+            u32                     m_num_sections;         // Number of sections, the first cMaxSections are in m_sections
+            u32                     m_padding;              //
+            u64                     m_committed_bytes;      // All bytes committed for user memory
+            u64                     m_used_bytes;           // Bytes of the live elements (element size)
+            u64                     m_free_element_bytes;   // Bytes of the free elements in chunks that hold live elements
+            u64                     m_cached_bytes;         // Bytes committed by cached (empty) chunks
+            u64                     m_recorded_bytes;       // Bytes of the live elements that have a recorded requested size
+            u64                     m_requested_bytes;      // Requested bytes of those elements
+            u64                     m_unused_address;       // Bytes of address space of the sections that are not committed
+            bin_fragmentation_t     m_bins[cMaxBinConfigs];
+            section_fragmentation_t m_sections[cMaxSections];
+
+            // Rounding requested sizes up to the element size, over the elements with a recorded size
+            inline f64 internal_fragmentation() const { return m_recorded_bytes > 0 ? (f64)(m_recorded_bytes - m_requested_bytes) / (f64)m_recorded_bytes : 0.0; }
+            // Committed memory that does not hold live elements
+            inline f64 external_fragmentation() const { return m_committed_bytes > 0 ? (f64)(m_committed_bytes - m_used_bytes) / (f64)m_committed_bytes : 0.0; }
+        };
+
+        // Called by vmalloc_t::visit for every live allocation, return false to stop the walk.
+        // 'size' is the usable size of the allocation (see get_size), 'tag' is 0 for a tagless allocator.
+        typedef bool (*visit_fn)(void* ptr, u32 size, u32 tag, void* user);
+
+        // Polled by the allocator (see vmalloc_t::set_pressure_source), return true when memory should be given
+        // back to the OS and set 'target_bytes' to the committed size to trim to (0 gives back all it can).
+        typedef bool (*pressure_fn)(void* user, u64& target_bytes);
+
+        // A ready-made pressure source for Linux, it reads the PSI (pressure stall information) of the cgroup v2 the
+        // process runs in (the '0::' line of /proc/self/cgroup), or the system wide PSI when there is none, and reports
+        // pressure when 'some avg10' is at or above the threshold. 'user' points to a u32 threshold in hundredths of a
+        // percent, nullptr uses 10%. Never reports pressure on other platforms.
+        extern bool gCgroupMemoryPressure(void* user, u64& target_bytes);
+
+        // Lifetime hint of an allocation, every lifetime has its own chunks and sections so that objects that are
+        // kept around for long do not pin chunks that are otherwise filled with short-lived objects.
+        enum lifetime_t
+        {
+            cLifetimeNormal     = 0,  // Unknown or mixed
+            cLifetimeTransient  = 1,  // Freed soon, e.g. request or frame scoped
+            cLifetimePersistent = 2,  // Kept for (almost) the lifetime of the allocator, e.g. configuration
+            cLifetimeCount      = 3,
+        };
+
+        // Returns the NUMA node of the calling thread, see numa_t
+        typedef u32 (*numa_node_fn)(void* user);
+
+        // NUMA mode of an address space, the address space is split into one range per node and a chunk is taken
+        // from a section in the range of the node the calling thread runs on. The pages of a range are bound to
+        // their node (mbind), unless the topology is faked by 'm_node_fn' (e.g. to test on a single node machine).
+        struct numa_t
+        {
+            enum
+            {
+                cMaxNodes = 64,
+            };
+
+            u32          m_num_nodes;  // Number of nodes, 0 = the nodes of the machine
+            u32          m_padding;    //
+            numa_node_fn m_node_fn;    // nullptr = ask the OS which node a thread runs on
+            void*        m_node_user;  // Passed to m_node_fn
+        };
+
+        // The attributes of an address region of a supermemory_t, the commit granularity and the protection of
+        // the committed pages are per region.
+        struct region_t
+        {
+            enum
+            {
+                cPagesDefault = 0,  // Huge pages for the chunk configs that ask for them (chunkconfig_t::m_hugepage)
+                cPagesSmall   = 1,  // Never huge pages, commit in system pages
+                cPagesHuge    = 2,  // Huge pages for every chunk that is at least a huge page in size
+            };
+            enum
+            {
+                cProtectReadWrite = 0,  //
+                cProtectReadOnly  = 1,  // E.g. a read-mostly region that is written in phases, see gProtectRegion
+            };
+
+            config_t const* m_config;    // nullptr = gConfigWindowsDesktopApp25p()
+            u8              m_pages;     // cPagesDefault, cPagesSmall or cPagesHuge
+            u8              m_protect;   // The protection of committed pages
+            u16             m_padding;   //
+            u32             m_padding2;  //
+        };
+
+        // Counters of a backend, kept by the offset and the device mock backends (the OS backend keeps none)
+        struct backend_stats_t
+        {
+            u64 m_reserved_bytes;        // Address space that is reserved
+            u64 m_committed_bytes;       // Bytes that are committed
+            u64 m_peak_committed_bytes;  // Highest number of committed bytes seen
+            u32 m_commit_calls;          //
+            u32 m_decommit_calls;        //
+        };
+
+        // The memory that a superspace manages, an address range that is reserved once and then committed and
+        // decommitted in pages. The bookkeeping of the allocator lives outside of this memory, so it can also be
+        // memory the CPU does not access (device memory, an externally owned or RDMA registered buffer pool).
+        // Note: The calls are made while holding the lock of the superspace. Huge page advice, NUMA binding and
+        //       region protection are only applied to the memory of the OS backend. With any other backend a
+        //       reallocation only succeeds in place, one that would have to move (and copy) returns nullptr and
+        //       leaves the allocation as it is. When commit fails the allocation that needed the pages returns
+        //       nullptr, decommit is only called for pages that were committed.
+        class backend_t
+        {
+        public:
+            virtual ~backend_t() {}
+
+            inline void* reserve(u64 size) { return v_reserve(size); }
+            inline void  release(void* address, u64 size) { v_release(address, size); }
+            inline bool  commit(void* address, u64 size) { return v_commit(address, size); }
+            inline void  decommit(void* address, u64 size) { v_decommit(address, size); }
+            inline s8    page_size_shift() const { return v_page_size_shift(); }
+            inline void  get_stats(backend_stats_t& stats) const { v_get_stats(stats); }
+
+        protected:
+            virtual void* v_reserve(u64 size)                       = 0;
+            virtual void  v_release(void* address, u64 size)        = 0;
+            virtual bool  v_commit(void* address, u64 size)         = 0;
+            virtual void  v_decommit(void* address, u64 size)       = 0;
+            virtual s8    v_page_size_shift() const                 = 0;
+            virtual void  v_get_stats(backend_stats_t& stats) const = 0;
+        };
+
+        // The virtual memory of the OS, the default backend
+        extern backend_t* gOsBackend();
+
+        // Hands out addresses without any memory behind them, an allocation is an offset from 'base' into memory
+        // that is managed elsewhere (e.g. a device heap). 'base' must be non-zero and aligned to the largest
+        // section size of the config, e.g. (u64)1 << 40.
+        extern backend_t* gCreateOffsetBackend(alloc_t* heap, u64 base, s8 page_size_shift);
+
+        // A device heap simulated with host memory, to test a non-OS backend locally. Commits and decommits are
+        // checked to be page aligned, inside the reserved range and balanced.
+        extern backend_t* gCreateDeviceMockBackend(alloc_t* heap);
+
+        extern void gDestroyBackend(alloc_t* heap, backend_t* backend);
+
         // A 'virtual memory' allocator, suitable for CPU as well as GPU memory
-        // Note: This interface is not thread-safe
+        // Note: This interface is not thread-safe, see gCreateVmAllocatorForThread for multi-threaded usage
         // Note: It is almost possible to even derive from dexer_t, the u32 index would consist of
         //       - segment index (8 bits)
         //       - chunk index (15 bits)
@@ -26,30 +247,138 @@ namespace ncore
         class vmalloc_t : public alloc_t
         {
         public:
+            using alloc_t::allocate;
+
+            // Allocate with a lifetime hint, a reallocation that moves keeps the lifetime of the allocation
+            inline void* allocate(u32 size, u32 align, lifetime_t hint) { return v_allocate_hinted(size, align, hint); }
+
             inline u32  get_size(void* ptr) const { return v_get_size(ptr); }
             inline void set_tag(void* ptr, u32 assoc) { return v_set_tag(ptr, assoc); }
             inline u32  get_tag(void* ptr) const { return v_get_tag(ptr); }
+            inline void get_stats(stats_t& stats) const { v_get_stats(stats); }
+
+            // Batch allocation/deallocation of same-size elements, cheaper than doing them one by one.
+            // allocate_n returns the number of elements that were allocated and written to 'out'.
+            inline u32  allocate_n(u32 size, u32 align, void** out, u32 count) { return v_allocate_n(size, align, out, count); }
+            inline void deallocate_n(void** ptrs, u32 count) { v_deallocate_n(ptrs, count); }
+
+            // Resize an allocation, in place when possible, otherwise the content is moved to a new allocation.
+            // A nullptr allocates, a new_size of 0 deallocates.
+            inline void* reallocate(void* ptr, u32 new_size, u32 align = sizeof(void*)) { return v_reallocate(ptr, new_size, align); }
+
+            // Allocate from a bin that was resolved at compile time by nconfig25p::size2bin (see g_allocate<T>), skipping
+            // the size to bin mapping. Falls back to 'allocate' when the config does not share that mapping (see
+            // config_t::m_static_size2bin) or the bin does not fit the alignment.
+            inline void* allocate_bin(u8 bin_index, u32 size, u32 align) { return v_allocate_bin(bin_index, size, align); }
+
+            // Record the requested size of every element of the chunks that are obtained from now on (4 bytes per
+            // element), analyze then reports requested bytes against element sizes. This is shared by all instances.
+            inline void record_sizes(bool enable) { v_record_sizes(enable); }
+
+            // Walk all sections, chunks and elements and report where the committed memory goes. With multiple
+            // threads the element counts of chunks owned by other threads are a snapshot.
+            inline void analyze(fragmentation_t& report) const { v_analyze(report); }
+
+            // Enumerate all live allocations (of all instances sharing the address space), e.g. for leak triage or a
+            // heap snapshot. The address space is only locked while a batch of elements is collected, the callback is
+            // called without the lock and may use the allocator; elements allocated or freed during the walk may or may
+            // not be reported. Elements freed by another thread that the owner did not collect yet are reported as live.
+            inline void visit(visit_fn fn, void* user) const { v_visit(fn, user); }
+
+            // Decommit cached chunks and empty sections until at most 'target_bytes' are committed, memory that holds
+            // live elements is never touched. Empty sections kept longer than the section cache time are released
+            // whatever the target. Returns the number of bytes given back, release() is trim(0).
+            inline u64 trim(u64 target_bytes) { return v_trim(target_bytes); }
+
+            // Install a memory pressure source (nullptr removes it), it is polled when a chunk is checked out but not
+            // more often than once every 'interval_ms'. This is shared by all instances.
+            inline void set_pressure_source(pressure_fn fn, void* user, u32 interval_ms) { v_set_pressure_source(fn, user, interval_ms); }
 
         protected:
-            virtual u32  v_get_size(void* ptr) const     = 0;
-            virtual void v_set_tag(void* ptr, u32 assoc) = 0;
-            virtual u32  v_get_tag(void* ptr) const      = 0;
+            virtual u32   v_get_size(void* ptr) const                                        = 0;
+            virtual void  v_set_tag(void* ptr, u32 assoc)                                    = 0;
+            virtual u32   v_get_tag(void* ptr) const                                         = 0;
+            virtual void  v_get_stats(stats_t& stats) const                                  = 0;
+            virtual u32   v_allocate_n(u32 size, u32 align, void** out, u32 count)           = 0;
+            virtual void  v_deallocate_n(void** ptrs, u32 count)                             = 0;
+            virtual void* v_reallocate(void* ptr, u32 new_size, u32 align)                   = 0;
+            virtual void* v_allocate_bin(u8 bin_index, u32 size, u32 align)                  = 0;
+            virtual void  v_record_sizes(bool enable)                                        = 0;
+            virtual void  v_analyze(fragmentation_t& report) const                           = 0;
+            virtual void  v_visit(visit_fn fn, void* user) const                             = 0;
+            virtual u64   v_trim(u64 target_bytes)                                           = 0;
+            virtual void  v_set_pressure_source(pressure_fn fn, void* user, u32 interval_ms) = 0;
+            virtual void* v_allocate_hinted(u32 size, u32 align, lifetime_t hint)            = 0;
         };
     }  // namespace nsuperalloc
 
+    // Typed allocation, the bin is resolved at compile time (types with an alignment larger than 16 take the regular path)
+    template <typename T>
+    inline T* g_allocate(nsuperalloc::vmalloc_t* a)
+    {
+        if (alignof(T) <= 16)
+            return (T*)a->allocate_bin(nsuperalloc::nconfig25p::size2bin_t<sizeof(T)>::value, sizeof(T), alignof(T));
+        return (T*)a->allocate(sizeof(T), alignof(T));
+    }
+
     // A 'virtual memory' allocator, suitable for CPU as well as GPU memory
-    extern nsuperalloc::vmalloc_t* gCreateVmAllocator(alloc_t* main_heap);
+    // Note: A 'tagless' allocator has no per element tag storage (saving 4 bytes per element and an
+    //       allocation per chunk), set_tag is ignored and get_tag always returns 0.
+    extern nsuperalloc::vmalloc_t* gCreateVmAllocator(alloc_t* main_heap, bool tagless = false);
+    extern nsuperalloc::vmalloc_t* gCreateVmAllocator(alloc_t* main_heap, nsuperalloc::config_t const* config, bool tagless = false);
+    extern nsuperalloc::vmalloc_t* gCreateVmAllocator(alloc_t* main_heap, nsuperalloc::config_t const* config, nsuperalloc::numa_t const& numa, bool tagless = false);
+    extern nsuperalloc::vmalloc_t* gCreateVmAllocator(alloc_t* main_heap, nsuperalloc::config_t const* config, nsuperalloc::backend_t* backend, bool tagless = false);
     extern void                    gDestroyVmAllocator(nsuperalloc::vmalloc_t* allocator);
 
+    // A child heap has its own chunks but takes them from the address space (superspace) of 'parent', which is
+    // an allocator from gCreateVmAllocator, gGetVmAllocatorOfThread or gCreateChildHeap. Destroying a child heap
+    // hands all of its chunks back at once, the allocations that are still live are discarded (not freed one by
+    // one), which makes it cheap to tear down per-request or per-job heaps.
+    // Note: Memory of a child heap must be freed through the child (freeing it through another heap terminates the
+    //       process), destroy the child heaps before their parent.
+    extern nsuperalloc::vmalloc_t* gCreateChildHeap(nsuperalloc::vmalloc_t* parent);
+    extern void                    gDestroyChildHeap(nsuperalloc::vmalloc_t* child);
+
+    // --------------------------------------------------------------------------------------------
+    // Super memory, a set of address regions that each have their own page attributes (see region_t)
+    // The regions are equal, power-of-two sized parts of one reserved address range, so the region of a pointer
+    // is a subtraction and a shift. Every region has its own superspace, the heaps that are created on the same
+    // region share it, each under an owner index of its own. Memory must be freed through the heap that allocated
+    // it, freeing it through another heap terminates the process.
+    // Note: gDestroyVmAllocator destroys a heap of a region, destroy all heaps before the super memory.
+    struct supermemory_t;
+
+    extern supermemory_t*          gCreateSuperMemory(alloc_t* main_heap, nsuperalloc::region_t const* regions, u32 num_regions, bool tagless = false);
+    extern void                    gDestroySuperMemory(supermemory_t* memory);
+    extern nsuperalloc::vmalloc_t* gCreateVmAllocator(supermemory_t* memory, u32 region_index);
+
+    // The index of the region that 'ptr' is in, the number of regions when it is not part of the super memory
+    extern u32 gRegionOf(supermemory_t const* memory, void const* ptr);
+
+    // Changes the protection of all committed pages of a region, pages that are committed later get it as well.
+    // Note: The allocator does not write to the elements it hands out, so a read-only region can still be
+    //       allocated from and freed to, the memory that is handed out is read-only until the protection changes.
+    extern void gProtectRegion(supermemory_t* memory, u32 region_index, u8 protect);
+
     // --------------------------------------------------------------------------------------------
     // A 'virtual memory' allocator, multi-thread safe
+    // All threads share one address space (superspace), every thread has its own allocator which is
+    // used by that thread only. Memory can be freed on any thread, when the memory is owned by the
+    // allocator of another thread it is handed over to that allocator without taking a lock.
+    // Note: 'thread_index' must be unique per live thread and smaller than 'max_threads'. A finalized
+    //       thread allocator stays alive (it still owns the memory of live allocations) and is adopted
+    //       by the next thread that is created with the same index.
     struct vm_allocator_threaded_context_t;
     struct vm_allocator_threaded_t;
 
-    extern vm_allocator_threaded_context_t* gCreateVmAllocatorThreadedContext(alloc_t* main_heap);
+    extern vm_allocator_threaded_context_t* gCreateVmAllocatorThreadedContext(alloc_t* main_heap, s16 max_threads = 64, bool tagless = false);
+    extern vm_allocator_threaded_context_t* gCreateVmAllocatorThreadedContext(alloc_t* main_heap, nsuperalloc::numa_t const& numa, s16 max_threads = 64, bool tagless = false);
+    extern void                             gDestroyVmAllocatorThreadedContext(vm_allocator_threaded_context_t* ctxt);
     extern vm_allocator_threaded_t*         gCreateVmAllocatorForThread(vm_allocator_threaded_context_t* ctxt, s16 thread_index);
     extern void                             gFinalizeVmAllocatorForThread(vm_allocator_threaded_context_t* ctxt, vm_allocator_threaded_t* allocator);
+    extern nsuperalloc::vmalloc_t*          gGetVmAllocatorOfThread(vm_allocator_threaded_t* allocator);
 
+    // Reclaim memory that other threads have freed, this is also done as part of allocating
     extern void gVmAllocatorCollectDeferred(vm_allocator_threaded_t* ctxt);
 };  // namespace ncore
 
@@ -7,6 +7,8 @@
 
 namespace ncore
 {
+    class alloc_t;
+
     namespace nsuperalloc
     {
         struct chunkconfig_t
@@ -15,6 +17,7 @@ namespace ncore
             s8 m_chunkconfig_index;  // The index of this chunk config in the chunk config array
             s8 m_cacheshift;         // The shift of the cache size (e.g. 6 for 64, -1 for none)
             s8 m_section_sizeshift;  // The size of the section this chunk config requires
+            s8 m_hugepage;           // 1 = commit in huge pages when the OS supports them (chunk size must be a multiple of it)
         };
 
         struct binconfig_t
@@ -22,18 +25,52 @@ namespace ncore
             binconfig_t(u32 alloc_size, chunkconfig_t const& chunk_config)
                 : m_alloc_size(alloc_size)
                 , m_chunk_config(chunk_config)
-                , m_max_alloc_count((((u32)1 << chunk_config.m_sizeshift) / alloc_size))
+                , m_max_alloc_count(s_max_alloc_count(alloc_size, chunk_config.m_sizeshift))
+                , m_index_mul(s_index_mul(alloc_size, chunk_config.m_sizeshift))
+                , m_index_shift(s_index_shift(alloc_size, chunk_config.m_sizeshift))
             {
             }
             binconfig_t(const binconfig_t& other)
                 : m_alloc_size(other.m_alloc_size)
                 , m_chunk_config(other.m_chunk_config)
                 , m_max_alloc_count(other.m_max_alloc_count)
+                , m_index_mul(other.m_index_mul)
+                , m_index_shift(other.m_index_shift)
             {
             }
+
+            // Element index of a byte offset within a chunk, equal to 'offset / m_alloc_size' for every offset in the chunk
+            inline u32 offset_to_index(u64 offset) const { return (u32)((offset * m_index_mul) >> m_index_shift); }
+
             const u32           m_alloc_size;       // The size of the allocation that this bin is managing
             const chunkconfig_t m_chunk_config;     // The index of the chunk size that this bin requires
             const u32           m_max_alloc_count;  // The maximum number of allocations that can be made from a single chunk
+            const u32           m_index_mul;        // Reciprocal of m_alloc_size, see offset_to_index()
+            const s8            m_index_shift;      // Shift that goes with m_index_mul
+
+        private:
+            // The binmap that tracks the free elements of a chunk can handle at most 4096 elements
+            static u32 s_max_alloc_count(u32 alloc_size, s8 chunk_sizeshift)
+            {
+                u32 const count = (u32)(((u64)1 << chunk_sizeshift) / alloc_size);
+                return (count < 4096) ? count : 4096;
+            }
+
+            // With chunk size 2^k and 2^(l-1) < alloc_size <= 2^l, the reciprocal m = ceil(2^(k+l) / alloc_size)
+            // is exact for all offsets < 2^k, since the error (offset * e) with e < alloc_size stays below 2^(k+l).
+            // m < 2^(k+1) + 1 fits in 32 bits and (offset * m) stays below 2^(2k+1), both fine for k <= 29 (512 MiB).
+            static s8 s_index_shift(u32 alloc_size, s8 chunk_sizeshift)
+            {
+                s8 l = 0;
+                while (((u64)1 << l) < alloc_size)
+                    l += 1;
+                return chunk_sizeshift + l;
+            }
+            static u32 s_index_mul(u32 alloc_size, s8 chunk_sizeshift)
+            {
+                u64 const p = (u64)1 << s_index_shift(alloc_size, chunk_sizeshift);
+                return (u32)((p + alloc_size - 1) / alloc_size);
+            }
         };
 
         struct config_t
@@ -47,15 +84,32 @@ namespace ncore
                 , m_internal_heap_pre_size(0)
                 , m_internal_fsa_block_count(1024)
                 , m_internal_fsa_block_size(65536)
+                , m_section_cache_count(1)
+                , m_section_cache_time_ms(10000)
                 , m_num_chunkconfigs(0)
                 , m_num_binconfigs(0)
+                , m_alignedbin_index(0)
+                , m_static_size2bin(false)
                 , m_achunkconfigs(nullptr)
                 , m_abinconfigs(nullptr)
             {
+                for (s32 i = 0; i < cSmallSizeCount; i++)
+                    m_small_size2bin[i] = 0;
             }
 
             virtual u8 size2bin(u32 size) const = 0;
 
+            // Sizes up to cSmallSizeMax are mapped to a bin with a table lookup, larger sizes use size2bin.
+            // The table holds the bin of every multiple of 8, see setup_small_size2bin().
+            enum
+            {
+                cSmallSizeMax   = 1024,
+                cSmallSizeShift = 3,
+                cSmallSizeCount = (cSmallSizeMax >> cSmallSizeShift) + 1,
+            };
+            inline u8 size2bin_fast(u32 size) const { return (size <= cSmallSizeMax) ? m_small_size2bin[(size + ((1 << cSmallSizeShift) - 1)) >> cSmallSizeShift] : size2bin(size); }
+            void      setup_small_size2bin();
+
             u64                  m_total_address_size;
             u64                  m_section_address_range;
             s8                   m_section_minsize_shift;
@@ -64,14 +118,63 @@ namespace ncore
             u32                  m_internal_heap_pre_size;
             u32                  m_internal_fsa_block_count;
             u32                  m_internal_fsa_block_size;
+            u32                  m_section_cache_count;    // Number of empty sections kept per chunk config
+            u32                  m_section_cache_time_ms;  // Time (ms) an empty section is kept before it is released
             s16                  m_num_chunkconfigs;
             s16                  m_num_binconfigs;
+            s16                  m_alignedbin_index;  // First 'aligned' bin, one per chunk config holding a single element per chunk
+            bool                 m_static_size2bin;   // The bins of nconfig25p::size2bin can be used as is (see gConfigValidate)
             chunkconfig_t const* m_achunkconfigs;
             binconfig_t const*   m_abinconfigs;
+            u8                   m_small_size2bin[cSmallSizeCount];
         };
 
         extern config_t const* gConfigWindowsDesktopApp10p();
         extern config_t const* gConfigWindowsDesktopApp25p();
+
+        // Parameters for computing a config at init time (see gConfigCompute), a port of docs/compute_bins.go
+        struct configgen_t
+        {
+            configgen_t()
+                : m_page_size(4096)
+                , m_waste_percentage(25)
+                , m_alloc_align(8)
+                , m_min_alloc_count(8)
+                , m_num_chunkconfigs(0)
+                , m_achunkconfigs(nullptr)
+                , m_base(nullptr)
+            {
+            }
+
+            u32                  m_page_size;         // Page size of the host (e.g. 4 KiB or 16 KiB), chunk sizes must be a multiple of it
+            u32                  m_waste_percentage;  // Maximum waste of a bin (rounding a size up to the bin and the unused part of the last page of a chunk)
+            u32                  m_alloc_align;       // Bin sizes are a multiple of this (power-of-two, at least 8)
+            u32                  m_min_alloc_count;   // A chunk should hold at least this many elements (when any chunk config can)
+            s16                  m_num_chunkconfigs;  // Number of chunk configs, 0 = the chunk configs of the default configs
+            chunkconfig_t const* m_achunkconfigs;     // Sorted by size, m_chunkconfig_index must be the index in this array
+            config_t const*      m_base;              // Other settings (address space, sections, internal heap), nullptr = gConfigWindowsDesktopApp25p()
+        };
+
+        // Compute and validate a config, returns nullptr when the parameters do not lead to a valid config.
+        // The config is allocated from 'heap' and must be destroyed with gConfigDestroy.
+        extern config_t const* gConfigCompute(alloc_t* heap, configgen_t const& params);
+        extern void            gConfigDestroy(alloc_t* heap, config_t const* config);
+        extern bool            gConfigValidate(config_t const* config);
+
+        // The size to bin mapping of gConfigWindowsDesktopApp25p() evaluated at compile time, used by the typed
+        // allocation helpers (see g_allocate<T>(vmalloc_t*)) to resolve the bin of a type without any runtime cost.
+        namespace nconfig25p
+        {
+            constexpr s32 clz32(u32 v, s32 n = 0) { return (n == 32 || (v & 0x80000000u) != 0) ? n : clz32(v << 1, n + 1); }
+            constexpr u8  size2bin_w(u32 size, s32 w) { return (u8)((((size + (((0x80000000u >> w) - 1) >> 2)) & ~(((0x80000000u >> w) - 1) >> 2)) >> (29 - w)) + ((29 - w) * 4)); }
+            constexpr u8  size2bin(u32 size) { return (size <= 16) ? size2bin_w(16, clz32(16)) : size2bin_w(size, clz32(size)); }
+
+            template <u32 N>
+            struct size2bin_t
+            {
+                static constexpr u8 value = size2bin(N);
+            };
+        }  // namespace nconfig25p
     }  // namespace nsuperalloc
 };  // namespace ncore
 
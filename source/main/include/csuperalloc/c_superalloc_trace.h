@@ -0,0 +1,85 @@
+#ifndef __C_SUPERALLOC_TRACE_H__
+#define __C_SUPERALLOC_TRACE_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+#    pragma once
+#endif
+
+#include "csuperalloc/c_superalloc.h"
+
+namespace ncore
+{
+    namespace nsuperalloc
+    {
+        // --------------------------------------------------------------------------------------------
+        // Allocation traces
+        //
+        // A trace is an array of records, every record is a pair of s32 words, this is the same layout
+        // as the 'allocdmp' array that is replayed by the stress test:
+        //
+        //   allocation     { size, 0 }                         size > 0
+        //   deallocation   { -size, record index of the alloc }
+        //   thread switch  { cTraceThread, thread index }      the following records are done by that thread
+        //
+        // A reallocation is recorded as a deallocation followed by an allocation, frees of memory that was
+        // allocated before the trace was started are not recorded.
+        enum
+        {
+            cTraceThread = (s32)0x80000000,
+        };
+
+        struct trace_t;
+
+        // Creates a trace that streams to 'filepath', when 'filepath' is nullptr the trace is kept in memory
+        // (see gTraceRecords). gDestroyTrace flushes and closes the file.
+        extern trace_t* gCreateTrace(alloc_t* heap, char const* filepath);
+        extern void     gDestroyTrace(trace_t* trace);
+
+        // The records of an in-memory trace, 'num_records' is the number of record pairs
+        extern s32 const* gTraceRecords(trace_t* trace, u32& num_records);
+
+        // A vmalloc_t that forwards to 'allocator' and records every allocation and deallocation in 'trace'.
+        // Every thread should have its own recording allocator (with its own thread index), the trace itself
+        // is shared and can be written by multiple threads.
+        extern vmalloc_t* gCreateRecordingAllocator(trace_t* trace, vmalloc_t* allocator, s16 thread_index);
+        extern void       gDestroyRecordingAllocator(vmalloc_t* recorder);
+
+        // The result of replaying a trace
+        struct replay_stats_t
+        {
+            enum
+            {
+                cAlloc   = 0,
+                cFree    = 1,
+                cOpTypes = 2,
+            };
+
+            u64 m_ops[cOpTypes];          // Number of replayed operations per type
+            u64 m_p50_ns[cOpTypes];       // Latency percentiles per type in nanoseconds (bucket upper bound, ~12% precision)
+            u64 m_p99_ns[cOpTypes];       //
+            u64 m_p999_ns[cOpTypes];      //
+            u64 m_total_ns;               // Time spent in the allocator
+            u64 m_ops_per_sec;            // Operations per second (based on m_total_ns)
+            u32 m_page_size;              // Size of a page in bytes
+            u32 m_peak_committed_pages;   // Highest number of committed pages seen (sampled)
+            u64 m_peak_live_bytes;        // Requested bytes that were live at that moment
+            u32 m_final_committed_pages;  // Committed pages at the end of the trace, before freeing what is still live
+            u64 m_final_live_bytes;       // Requested bytes that are still live at the end of the trace
+            u32 m_failed_allocs;          // Allocations that returned nullptr
+            u32 m_padding;
+
+            // The fraction of committed memory that does not hold requested bytes (0.0 = none, 1.0 = all)
+            f64 peak_fragmentation() const;
+            f64 final_fragmentation() const;
+        };
+
+        // Replays 'num_records' record pairs, a thread switch record selects 'allocators[thread index % num_allocators]'
+        // for the records that follow it. Statistics are taken from the first allocator, with multiple allocators
+        // they should share an address space (gCreateVmAllocatorForThread). Everything still live at the end of the
+        // trace is freed. Returns false when a record is malformed.
+        extern bool gReplayTrace(alloc_t* heap, vmalloc_t** allocators, u32 num_allocators, s32 const* records, u32 num_records, replay_stats_t& result);
+
+    }  // namespace nsuperalloc
+}  // namespace ncore
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef __CSUPERALLOC_MULTITHREAD_H_
+#define __CSUPERALLOC_MULTITHREAD_H_
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+#    pragma once
+#endif
+
+#if defined(_MSC_VER)
+#    include <intrin.h>
+#endif
+
+namespace ncore
+{
+    // Minimal set of atomic operations used by the allocator, all with sequential consistency
+    // unless the name says otherwise.
+    namespace natomic
+    {
+#if defined(_MSC_VER)
+        inline void* load_ptr(void* volatile const* ptr) { return *ptr; }
+        inline void  store_ptr(void* volatile* ptr, void* value) { _InterlockedExchangePointer((void* volatile*)ptr, value); }
+        inline void* exchange_ptr(void* volatile* ptr, void* value) { return _InterlockedExchangePointer((void* volatile*)ptr, value); }
+        inline bool  cas_ptr(void* volatile* ptr, void*& expected, void* desired)
+        {
+            void* const previous = _InterlockedCompareExchangePointer((void* volatile*)ptr, desired, expected);
+            if (previous == expected)
+                return true;
+            expected = previous;
+            return false;
+        }
+        inline s32  load_s32(s32 volatile const* ptr) { return *ptr; }
+        inline void store_s32(s32 volatile* ptr, s32 value) { _InterlockedExchange((long volatile*)ptr, (long)value); }
+        inline s32  exchange_s32(s32 volatile* ptr, s32 value) { return (s32)_InterlockedExchange((long volatile*)ptr, (long)value); }
+        inline s32  add_s32(s32 volatile* ptr, s32 value) { return (s32)_InterlockedExchangeAdd((long volatile*)ptr, (long)value) + value; }
+        inline u32  load_u32(u32 volatile const* ptr) { return *ptr; }
+        inline u64  load_u64(u64 volatile const* ptr) { return *ptr; }
+        inline void store_u64(u64 volatile* ptr, u64 value) { _InterlockedExchange64((__int64 volatile*)ptr, (__int64)value); }
+        inline bool cas_u64(u64 volatile* ptr, u64& expected, u64 desired)
+        {
+            u64 const previous = (u64)_InterlockedCompareExchange64((__int64 volatile*)ptr, (__int64)desired, (__int64)expected);
+            if (previous == expected)
+                return true;
+            expected = previous;
+            return false;
+        }
+        inline void pause() { _mm_pause(); }
+#else
+        inline void* load_ptr(void* volatile const* ptr) { return __atomic_load_n(ptr, __ATOMIC_ACQUIRE); }
+        inline void  store_ptr(void* volatile* ptr, void* value) { __atomic_store_n(ptr, value, __ATOMIC_RELEASE); }
+        inline void* exchange_ptr(void* volatile* ptr, void* value) { return __atomic_exchange_n(ptr, value, __ATOMIC_ACQ_REL); }
+        inline bool  cas_ptr(void* volatile* ptr, void*& expected, void* desired) { return __atomic_compare_exchange_n(ptr, &expected, desired, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); }
+        inline s32   load_s32(s32 volatile const* ptr) { return __atomic_load_n(ptr, __ATOMIC_ACQUIRE); }
+        inline void  store_s32(s32 volatile* ptr, s32 value) { __atomic_store_n(ptr, value, __ATOMIC_RELEASE); }
+        inline s32   exchange_s32(s32 volatile* ptr, s32 value) { return __atomic_exchange_n(ptr, value, __ATOMIC_ACQ_REL); }
+        inline s32   add_s32(s32 volatile* ptr, s32 value) { return __atomic_add_fetch(ptr, value, __ATOMIC_ACQ_REL); }
+        inline u32   load_u32(u32 volatile const* ptr) { return __atomic_load_n(ptr, __ATOMIC_ACQUIRE); }
+        inline u64   load_u64(u64 volatile const* ptr) { return __atomic_load_n(ptr, __ATOMIC_ACQUIRE); }
+        inline void  store_u64(u64 volatile* ptr, u64 value) { __atomic_store_n(ptr, value, __ATOMIC_RELEASE); }
+        inline bool  cas_u64(u64 volatile* ptr, u64& expected, u64 desired) { return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); }
+#    if defined(__x86_64__) || defined(__i386__)
+        inline void pause() { __builtin_ia32_pause(); }
+#    elif defined(__aarch64__)
+        inline void pause() { __asm__ __volatile__("yield"); }
+#    else
+        inline void pause() {}
+#    endif
+#endif
+    }  // namespace natomic
+
+    // A test-and-test-and-set spin lock, used to guard the (rarely taken) shared paths of the
+    // allocator, like obtaining a chunk from or returning a chunk to the superspace.
+    struct spinlock_t
+    {
+        s32 volatile m_lock;
+
+        spinlock_t()
+            : m_lock(0)
+        {
+        }
+
+        inline void initialize() { m_lock = 0; }
+
+        void lock();
+        void unlock();
+    };
+
+    struct scoped_spinlock_t
+    {
+        inline scoped_spinlock_t(spinlock_t& lock)
+            : m_lock(lock)
+        {
+            m_lock.lock();
+        }
+        inline ~scoped_spinlock_t() { m_lock.unlock(); }
+
+    private:
+        spinlock_t& m_lock;
+    };
+
+}  // namespace ncore
+
+#endif  // __CSUPERALLOC_MULTITHREAD_H_
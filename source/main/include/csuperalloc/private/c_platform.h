@@ -0,0 +1,54 @@
+#ifndef __CSUPERALLOC_PLATFORM_H_
+#define __CSUPERALLOC_PLATFORM_H_
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+#    pragma once
+#endif
+
+namespace ncore
+{
+    // Platform specific functionality that is not provided by ccore
+    namespace nplatform
+    {
+        // Monotonic time in milliseconds
+        u64 time_ms();
+
+        // Monotonic time in microseconds
+        u64 time_us();
+
+        // Monotonic time in nanoseconds
+        u64 time_ns();
+
+        // The size (log2) of a huge page, 0 when huge pages are not available for reserved/committed memory
+        s8 hugepage_size_shift();
+
+        // Advise the OS to back a committed (huge page aligned) range with huge pages
+        bool advise_hugepages(void* address, u64 size);
+
+        // NUMA topology, a machine without NUMA (or a platform where it is not supported) has a single node 0
+        u32 numa_node_count();
+        u32 numa_current_node();
+
+        // Bind a (committed, untouched) range to a node, pages are then backed by memory of that node on first touch
+        bool numa_bind(void* address, u64 size, u32 node);
+
+        // Change the protection of a committed range to read-only or read-write
+        bool protect_pages(void* address, u64 size, bool read_only);
+
+        // The memory PSI (pressure stall information) of the cgroup v2 of the process (see /proc/self/cgroup), or the
+        // system when there is none, as 'some avg10' in hundredths of a percent. Returns false when it is not available
+        // (Linux only).
+        bool memory_pressure(u32& some_avg10);
+
+        // Minimal (binary) file output, file_open_write creates or truncates the file, returns nullptr on failure
+        void* file_open_write(const char* filepath);
+        bool  file_write(void* file, void const* data, u64 size);
+        void  file_close(void* file);
+
+        // Reports a misuse of the allocator that cannot be recovered from (also in release builds) and terminates the process
+        void fatal(const char* message);
+    }  // namespace nplatform
+
+}  // namespace ncore
+
+#endif  // __CSUPERALLOC_PLATFORM_H_
@@ -1,5 +1,6 @@
 #include "cbase/c_allocator.h"
 #include "cbase/c_integer.h"
+#include "ccore/c_memory.h"
 #include "ccore/c_random.h"
 
 #include "csuperalloc/c_lsa.h"
@@ -71,6 +72,34 @@ UNITTEST_SUITE_BEGIN(lsa)
             nlsa::destroy(lsa);
         }
 
+        // The size of an allocation is its number of committed pages
+        static u32 s_page_round(u32 size)
+        {
+            u32 const page_size = v_alloc_get_page_size();
+            return (size + page_size - 1) & ~(page_size - 1);
+        }
+
+        UNITTEST_TEST(init_alloc_reallocate_release)
+        {
+            lsa_t* lsa = nlsa::new_lsa(1024 * cKB, 64);
+
+            void* ptr = nlsa::allocate(lsa, 100 * cKB);
+            CHECK_EQUAL(s_page_round(100 * cKB), nlsa::get_size(lsa, ptr));
+
+            // Grows and shrinks in place up to the block size
+            CHECK_TRUE(ptr == nlsa::reallocate(lsa, ptr, 1000 * cKB));
+            CHECK_EQUAL(s_page_round(1000 * cKB), nlsa::get_size(lsa, ptr));
+            CHECK_TRUE(ptr == nlsa::reallocate(lsa, ptr, 8 * cKB));
+            CHECK_EQUAL(s_page_round(8 * cKB), nlsa::get_size(lsa, ptr));
+
+            // Beyond the block size it fails and leaves the allocation untouched
+            CHECK_TRUE(nullptr == nlsa::reallocate(lsa, ptr, 2048 * cKB));
+            CHECK_EQUAL(s_page_round(8 * cKB), nlsa::get_size(lsa, ptr));
+
+            nlsa::deallocate(lsa, ptr);
+            nlsa::destroy(lsa);
+        }
+
         // Allocate and deallocate randomly many different sizes and lifetimes
         UNITTEST_TEST(stress_test)
         {
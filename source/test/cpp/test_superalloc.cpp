@@ -2,6 +2,9 @@
 #include "cbase/c_integer.h"
 
 #include "csuperalloc/c_superalloc.h"
+#include "csuperalloc/c_superalloc_config.h"
+#include "csuperalloc/c_superalloc_trace.h"
+#include "csuperalloc/private/c_platform.h"
 #include "ccore/c_arena.h"
 
 #include "cunittest/cunittest.h"
@@ -31,7 +34,7 @@ public:
 
     void init(alloc_t* allocator) { mAllocator = gCreateVmAllocator(allocator); }
 
-    void release(alloc_t* allocator)
+    void release(alloc_t*)
     {
         gDestroyVmAllocator(mAllocator);
         mAllocator = nullptr;
@@ -57,6 +60,11 @@ public:
     inline u32  get_tag(void* mem) const { return mAllocator->get_tag(mem); }
 };
 
+struct typed_100_t
+{
+    u8 m_data[100];
+};
+
 UNITTEST_SUITE_BEGIN(main_allocator)
 {
     UNITTEST_FIXTURE(main)
@@ -137,6 +145,1074 @@ UNITTEST_SUITE_BEGIN(main_allocator)
             s_alloc.release(Allocator);
         }
 
+        UNITTEST_TEST(chunk_cache_limit)
+        {
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator);
+
+            nsuperalloc::stats_t stats;
+            valloc->get_stats(stats);
+            CHECK_EQUAL((u32)0, stats.m_committed_pages);
+
+            // 16 byte elements live in 64 KiB chunks, those are cached when they become empty
+            void* small = valloc->allocate(16);
+            valloc->deallocate(small);
+            valloc->get_stats(stats);
+            CHECK_EQUAL((u32)1, stats.m_chunkconfigs[0].m_chunks_cached);
+            CHECK_EQUAL((u32)16, stats.m_chunkconfigs[0].m_chunks_cached_max);
+            CHECK_EQUAL(stats.m_chunkconfigs[0].m_cached_pages, stats.m_committed_pages);
+
+            // 200 KiB elements live in 2 MiB chunks, those are not cached (m_cacheshift = -1)
+            void* large = valloc->allocate(200 * 1024);
+            valloc->deallocate(large);
+            valloc->get_stats(stats);
+            CHECK_EQUAL((u32)0, stats.m_chunkconfigs[4].m_chunks_cached);
+            CHECK_EQUAL((u32)0, stats.m_chunkconfigs[4].m_chunks_cached_max);
+            CHECK_EQUAL(stats.m_chunkconfigs[0].m_cached_pages, stats.m_committed_pages);
+
+            gDestroyVmAllocator(valloc);
+        }
+
+        UNITTEST_TEST(stats_per_bin_and_chunkconfig)
+        {
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator);
+
+            const s32 num_allocs = 10;
+            void*     ptr[num_allocs];
+            for (s32 i = 0; i < num_allocs; ++i)
+                ptr[i] = valloc->allocate(100);
+
+            nsuperalloc::stats_t stats;
+            valloc->get_stats(stats);
+            CHECK_TRUE(stats.m_num_binconfigs > 0);
+            CHECK_TRUE(stats.m_internal_fsa_size > 0);
+
+            u32 bin = 0;
+            while (bin < stats.m_num_binconfigs && stats.m_bins[bin].m_elements_used == 0)
+                bin += 1;
+            CHECK_TRUE(bin < stats.m_num_binconfigs);
+            CHECK_EQUAL((u32)112, stats.m_bins[bin].m_alloc_size);
+            CHECK_EQUAL((u32)num_allocs, stats.m_bins[bin].m_elements_used);
+            CHECK_EQUAL((u32)1, stats.m_bins[bin].m_chunks_active);
+            CHECK_EQUAL((u32)0, stats.m_bins[bin].m_chunks_full);
+
+            CHECK_EQUAL((u32)1, stats.m_chunkconfigs[0].m_chunks_used);
+            CHECK_EQUAL((u32)1, stats.m_chunkconfigs[0].m_sections_used);
+            CHECK_EQUAL(stats.m_committed_pages, stats.m_chunkconfigs[0].m_committed_pages);
+
+            for (s32 i = 0; i < num_allocs; ++i)
+                valloc->deallocate(ptr[i]);
+
+            valloc->get_stats(stats);
+            CHECK_EQUAL((u32)0, stats.m_bins[bin].m_elements_used);
+            CHECK_EQUAL((u32)0, stats.m_bins[bin].m_chunks_active);
+            CHECK_EQUAL((u32)0, stats.m_chunkconfigs[0].m_chunks_used);
+            CHECK_EQUAL((u32)1, stats.m_chunkconfigs[0].m_chunks_cached);
+
+            gDestroyVmAllocator(valloc);
+        }
+
+        UNITTEST_TEST(section_cache_reuse)
+        {
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator);
+
+            // A single allocation in a rarely used bin, released and obtained again, should keep
+            // reusing the same section (and thus address) instead of obtaining a new one.
+            void* first = valloc->allocate(200 * 1024);
+            valloc->deallocate(first);
+
+            nsuperalloc::stats_t stats;
+            valloc->get_stats(stats);
+            CHECK_EQUAL((u32)1, stats.m_chunkconfigs[4].m_sections_cached);
+
+            for (s32 i = 0; i < 16; ++i)
+            {
+                void* ptr = valloc->allocate(200 * 1024);
+                CHECK_TRUE(ptr == first);
+                valloc->get_stats(stats);
+                CHECK_EQUAL((u32)0, stats.m_chunkconfigs[4].m_sections_cached);
+                valloc->deallocate(ptr);
+            }
+
+            gDestroyVmAllocator(valloc);
+        }
+
+        UNITTEST_TEST(allocate_n_deallocate_n)
+        {
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator);
+
+            const u32 num_allocs = 128;
+            void*     ptr[num_allocs];
+            CHECK_EQUAL(num_allocs, valloc->allocate_n(48, 8, ptr, num_allocs));
+            for (u32 i = 0; i < num_allocs; ++i)
+            {
+                CHECK_TRUE(ptr[i] != nullptr);
+                CHECK_EQUAL((u32)48, valloc->get_size(ptr[i]));
+                for (u32 j = 0; j < i; ++j)
+                    CHECK_TRUE(ptr[i] != ptr[j]);
+            }
+            valloc->deallocate_n(ptr, num_allocs);
+
+            // All elements are back, so the chunk is now in the cache
+            nsuperalloc::stats_t stats;
+            valloc->get_stats(stats);
+            CHECK_EQUAL((u32)1, stats.m_chunkconfigs[0].m_chunks_cached);
+
+            gDestroyVmAllocator(valloc);
+        }
+
+        UNITTEST_TEST(aligned_alloc)
+        {
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator);
+
+            // Up to the page size a bin is chosen whose element size guarantees the alignment
+            void* ptr64 = valloc->allocate(100, 64);
+            CHECK_EQUAL((ptr_t)0, (ptr_t)ptr64 & (ptr_t)(64 - 1));
+            CHECK_EQUAL((u32)128, valloc->get_size(ptr64));
+            void* ptr4k = valloc->allocate(100, 4 * cKB);
+            CHECK_EQUAL((ptr_t)0, (ptr_t)ptr4k & (ptr_t)(4 * cKB - 1));
+
+            // Larger alignments get a chunk of their own, only the used pages are committed
+            nsuperalloc::stats_t stats;
+            valloc->get_stats(stats);
+            u32 const committed_pages = stats.m_committed_pages;
+
+            void* ptr64k = valloc->allocate(100, 64 * cKB);
+            void* ptr2m  = valloc->allocate(100, 2 * cMB);
+            CHECK_EQUAL((ptr_t)0, (ptr_t)ptr64k & (ptr_t)(64 * cKB - 1));
+            CHECK_EQUAL((ptr_t)0, (ptr_t)ptr2m & (ptr_t)(2 * cMB - 1));
+            CHECK_EQUAL(stats.m_page_size, valloc->get_size(ptr2m));
+
+            valloc->get_stats(stats);
+            CHECK_EQUAL((u32)2, stats.m_aligned_count);
+            CHECK_EQUAL((u32)2, stats.m_aligned_pages);
+            CHECK_EQUAL(committed_pages + 2, stats.m_committed_pages);
+            CHECK_EQUAL((u64)(64 * cKB + 2 * cMB) - 2 * stats.m_page_size, stats.m_aligned_waste);
+
+            valloc->deallocate(ptr2m);
+            valloc->deallocate(ptr64k);
+            valloc->deallocate(ptr4k);
+            valloc->deallocate(ptr64);
+
+            valloc->get_stats(stats);
+            CHECK_EQUAL((u32)0, stats.m_aligned_count);
+            CHECK_EQUAL((u64)0, stats.m_aligned_waste);
+
+            gDestroyVmAllocator(valloc);
+        }
+
+        UNITTEST_TEST(reallocate)
+        {
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator);
+
+            // Within the bin the pointer stays the same
+            void* ptr = valloc->reallocate(nullptr, 100);
+            valloc->set_tag(ptr, 0x1234);
+            CHECK_TRUE(ptr == valloc->reallocate(ptr, 112));
+
+            // Growing beyond the bin moves the content (and tag), a large enough size gets a chunk of its own
+            ((u32*)ptr)[0]  = 0xDEADBEEF;
+            void* const log = valloc->reallocate(ptr, 1 * cMB);
+            CHECK_TRUE(log != ptr);
+            CHECK_EQUAL((u32)0xDEADBEEF, ((u32*)log)[0]);
+            CHECK_EQUAL((u32)0x1234, valloc->get_tag(log));
+            CHECK_EQUAL((u32)1 * cMB, valloc->get_size(log));
+
+            // That chunk grows and shrinks in place by committing and decommitting pages
+            CHECK_TRUE(log == valloc->reallocate(log, 2 * cMB));
+            CHECK_EQUAL((u32)2 * cMB, valloc->get_size(log));
+            CHECK_TRUE(log == valloc->reallocate(log, 64 * cKB));
+            CHECK_EQUAL((u32)64 * cKB, valloc->get_size(log));
+            CHECK_EQUAL((u32)0xDEADBEEF, ((u32*)log)[0]);
+
+            CHECK_TRUE(nullptr == valloc->reallocate(log, 0));
+
+            nsuperalloc::stats_t stats;
+            valloc->get_stats(stats);
+            CHECK_EQUAL((u32)0, stats.m_aligned_count);
+
+            gDestroyVmAllocator(valloc);
+        }
+
+        UNITTEST_TEST(threaded_alloc_dealloc_other_thread)
+        {
+            vm_allocator_threaded_context_t* ctxt = gCreateVmAllocatorThreadedContext(Allocator, 4);
+
+            vm_allocator_threaded_t* thread0 = gCreateVmAllocatorForThread(ctxt, 0);
+            vm_allocator_threaded_t* thread1 = gCreateVmAllocatorForThread(ctxt, 1);
+            CHECK_TRUE(thread0 != thread1);
+            CHECK_TRUE(thread0 == gCreateVmAllocatorForThread(ctxt, 0));
+
+            nsuperalloc::vmalloc_t* alloc0 = gGetVmAllocatorOfThread(thread0);
+            nsuperalloc::vmalloc_t* alloc1 = gGetVmAllocatorOfThread(thread1);
+
+            const s32 num_allocs = 64;
+            void*     ptr[num_allocs];
+            for (s32 i = 0; i < num_allocs; ++i)
+            {
+                ptr[i] = alloc0->allocate(100);
+                alloc0->set_tag(ptr[i], i);
+            }
+            for (s32 i = 0; i < num_allocs; ++i)
+            {
+                CHECK_EQUAL((u32)i, alloc1->get_tag(ptr[i]));
+                CHECK_EQUAL((u32)112, alloc1->get_size(ptr[i]));
+            }
+
+            // Freeing on 'thread 1' defers the elements to the owner, 'thread 0'
+            for (s32 i = 0; i < num_allocs; ++i)
+                alloc1->deallocate(ptr[i]);
+            gVmAllocatorCollectDeferred(thread0);
+
+            // The reclaimed elements are handed out again
+            void* reuse = alloc0->allocate(100);
+            CHECK_TRUE(reuse != nullptr);
+            alloc0->deallocate(reuse);
+
+            gFinalizeVmAllocatorForThread(ctxt, thread1);
+            gFinalizeVmAllocatorForThread(ctxt, thread0);
+            gDestroyVmAllocatorThreadedContext(ctxt);
+        }
+
+        UNITTEST_TEST(tagless)
+        {
+            nsuperalloc::vmalloc_t* tagged   = gCreateVmAllocator(Allocator);
+            nsuperalloc::vmalloc_t* tagless  = gCreateVmAllocator(Allocator, true);
+            u32 const               chunks   = 64;
+            u32 const               elements = 64 * cKB / 16;  // Elements of the 16 byte bin in a 64 KiB chunk
+
+            // Every first allocation in a chunk checks out a chunk (csuperalloc_bench suite tagless reports the checkout time)
+            void** tagged_ptrs  = (void**)Allocator->allocate(sizeof(void*) * chunks);
+            void** tagless_ptrs = (void**)Allocator->allocate(sizeof(void*) * chunks);
+            for (u32 c = 0; c < chunks; ++c)
+            {
+                tagged_ptrs[c]  = tagged->allocate(16);
+                tagless_ptrs[c] = tagless->allocate(16);
+                for (u32 e = 1; e < elements; ++e)
+                {
+                    tagged->allocate(16);
+                    tagless->allocate(16);
+                }
+            }
+
+            // The tag arrays are the bulk of the per chunk metadata of the 16 byte bin
+            nsuperalloc::stats_t tagged_stats;
+            nsuperalloc::stats_t tagless_stats;
+            tagged->get_stats(tagged_stats);
+            tagless->get_stats(tagless_stats);
+            CHECK_EQUAL(tagged_stats.m_committed_pages, tagless_stats.m_committed_pages);
+            CHECK_TRUE(tagless_stats.m_internal_fsa_size + (u64)chunks * elements * sizeof(u32) <= tagged_stats.m_internal_fsa_size);
+
+            tagless->set_tag(tagless_ptrs[0], 123);
+            CHECK_EQUAL((u32)0, tagless->get_tag(tagless_ptrs[0]));
+            tagged->set_tag(tagged_ptrs[0], 123);
+            CHECK_EQUAL((u32)123, tagged->get_tag(tagged_ptrs[0]));
+
+            // Freed elements are handed out again
+            tagless->deallocate(tagless_ptrs[1]);
+            CHECK_TRUE(tagless_ptrs[1] == tagless->allocate(16));
+
+            Allocator->deallocate(tagged_ptrs);
+            Allocator->deallocate(tagless_ptrs);
+            gDestroyVmAllocator(tagless);
+            gDestroyVmAllocator(tagged);
+        }
+
+        UNITTEST_TEST(config_validate)
+        {
+            CHECK_TRUE(nsuperalloc::gConfigValidate(nsuperalloc::gConfigWindowsDesktopApp25p()));
+            CHECK_TRUE(nsuperalloc::gConfigValidate(nsuperalloc::gConfigWindowsDesktopApp10p()));
+        }
+
+        UNITTEST_TEST(config_compute)
+        {
+            u32 const page_sizes[]  = {4 * cKB, 16 * cKB};
+            u32 const waste[]       = {25, 10};
+            u32 const alloc_sizes[] = {8, 24, 100, 1000, 5000, 70 * cKB, 300 * cKB, 3 * cMB};
+            for (s32 i = 0; i < 2; ++i)
+            {
+                nsuperalloc::configgen_t params;
+                params.m_page_size        = page_sizes[i];
+                params.m_waste_percentage = waste[i];
+
+                nsuperalloc::config_t const* config = nsuperalloc::gConfigCompute(Allocator, params);
+                CHECK_TRUE(config != nullptr);
+                CHECK_TRUE(config->m_num_binconfigs <= 256);
+                for (s16 b = 0; b < config->m_alignedbin_index; ++b)
+                {
+                    nsuperalloc::binconfig_t const& bin = config->m_abinconfigs[b];
+                    CHECK_TRUE(bin.m_max_alloc_count >= 1 && bin.m_max_alloc_count <= 4096);
+                    CHECK_EQUAL((u32)0, ((u32)1 << bin.m_chunk_config.m_sizeshift) & (page_sizes[i] - 1));
+                    CHECK_EQUAL((u32)0, bin.m_alloc_size & 7);
+                }
+
+                nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator, config);
+                for (u32 a = 0; a < sizeof(alloc_sizes) / sizeof(alloc_sizes[0]); ++a)
+                {
+                    void* ptr = valloc->allocate(alloc_sizes[a]);
+                    CHECK_TRUE(ptr != nullptr);
+                    CHECK_TRUE(valloc->get_size(ptr) >= alloc_sizes[a]);
+                    valloc->deallocate(ptr);
+                }
+                gDestroyVmAllocator(valloc);
+
+                nsuperalloc::gConfigDestroy(Allocator, config);
+            }
+
+            // A waste target of 10% gives 8 bins per power-of-two, 100 bytes goes to the 104 byte bin
+            nsuperalloc::configgen_t params;
+            params.m_waste_percentage           = 10;
+            nsuperalloc::config_t const* config = nsuperalloc::gConfigCompute(Allocator, params);
+            CHECK_EQUAL((u32)104, config->m_abinconfigs[config->size2bin(100)].m_alloc_size);
+            nsuperalloc::gConfigDestroy(Allocator, config);
+        }
+
+        UNITTEST_TEST(size2bin_compile_time)
+        {
+            nsuperalloc::config_t const* config = nsuperalloc::gConfigWindowsDesktopApp25p();
+
+            // Compile time, table and virtual size to bin mapping agree
+            for (u32 size = 16; size <= 1 * cMB; size += (size < 4096) ? 1 : 61)
+            {
+                u8 const bin_index = config->size2bin(size);
+                CHECK_EQUAL(bin_index, nsuperalloc::nconfig25p::size2bin(size));
+                CHECK_EQUAL(config->m_abinconfigs[bin_index].m_alloc_size, config->m_abinconfigs[config->size2bin_fast(size)].m_alloc_size);
+            }
+            for (u32 size = 1; size < 16; ++size)
+                CHECK_EQUAL((u32)16, config->m_abinconfigs[config->size2bin_fast(size)].m_alloc_size);
+
+            u8 const bin_index = nsuperalloc::nconfig25p::size2bin_t<sizeof(typed_100_t)>::value;
+            CHECK_EQUAL((u32)112, config->m_abinconfigs[bin_index].m_alloc_size);
+
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator);
+            typed_100_t*            typed  = g_allocate<typed_100_t>(valloc);
+            CHECK_TRUE(typed != nullptr);
+            CHECK_EQUAL((u32)112, valloc->get_size(typed));
+
+            // Types up to 16 bytes use the compile time bin as is, the runtime maps them to a bin of the same size
+            CHECK_TRUE(config->m_static_size2bin);
+            u64* small = g_allocate<u64>(valloc);
+            CHECK_TRUE(small != nullptr);
+            CHECK_EQUAL((u32)16, valloc->get_size(small));
+
+            valloc->deallocate(small);
+            valloc->deallocate(typed);
+            gDestroyVmAllocator(valloc);
+
+            // Any other config maps the size to one of its own bins
+            nsuperalloc::config_t const* config10p = nsuperalloc::gConfigWindowsDesktopApp10p();
+            CHECK_TRUE(!config10p->m_static_size2bin);
+            valloc    = gCreateVmAllocator(Allocator, config10p);
+            void* ptr = valloc->allocate_bin(bin_index, 100, 8);
+            CHECK_EQUAL(config10p->m_abinconfigs[config10p->size2bin(100)].m_alloc_size, valloc->get_size(ptr));
+            valloc->deallocate(ptr);
+            gDestroyVmAllocator(valloc);
+        }
+
+        UNITTEST_TEST(bin_offset_to_index)
+        {
+            nsuperalloc::config_t const* config = nsuperalloc::gConfigWindowsDesktopApp25p();
+            for (s16 b = 0; b < config->m_num_binconfigs; ++b)
+            {
+                nsuperalloc::binconfig_t const& bin        = config->m_abinconfigs[b];
+                u64 const                       chunk_size = (u64)1 << bin.m_chunk_config.m_sizeshift;
+                if (chunk_size <= 64 * cKB)
+                {
+                    // Every offset in the chunk
+                    for (u64 offset = 0; offset < chunk_size; ++offset)
+                        CHECK_EQUAL((u32)(offset / bin.m_alloc_size), bin.offset_to_index(offset));
+                }
+                else
+                {
+                    // Element boundaries and the last offset in the chunk
+                    for (u32 e = 0; e < bin.m_max_alloc_count; ++e)
+                    {
+                        CHECK_EQUAL(e, bin.offset_to_index((u64)e * bin.m_alloc_size));
+                        CHECK_EQUAL(e, bin.offset_to_index((u64)e * bin.m_alloc_size + bin.m_alloc_size - 1));
+                    }
+                    CHECK_EQUAL((u32)((chunk_size - 1) / bin.m_alloc_size), bin.offset_to_index(chunk_size - 1));
+                }
+            }
+        }
+
+        UNITTEST_TEST(hugepage_commit_granularity)
+        {
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator);
+
+            // A 32 MiB allocation is served by a 32 MiB chunk, which is backed by huge pages when the OS supports them
+            // (csuperalloc_bench suite tlb-walk reports the effect on a page walk)
+            u64 const block_size = 32 * cMB;
+            u8*       huge       = (u8*)valloc->allocate((u32)block_size, 2 * cMB);
+            CHECK_TRUE(huge != nullptr);
+            CHECK_EQUAL((u32)block_size, valloc->get_size(huge));
+
+            nsuperalloc::stats_t stats;
+            valloc->get_stats(stats);
+            s8 const hugepage_shift = nplatform::hugepage_size_shift();
+            if (hugepage_shift > 0)
+            {
+                u32 const pages_per_hugepage = ((u32)1 << hugepage_shift) / stats.m_page_size;
+                CHECK_EQUAL((u32)0, stats.m_committed_pages & (pages_per_hugepage - 1));
+            }
+
+            valloc->deallocate(huge);
+            gDestroyVmAllocator(valloc);
+        }
+
+        struct visit_state_t
+        {
+            u32 m_count;
+            u32 m_limit;
+            u64 m_size;
+            u64 m_tags;
+        };
+
+        static bool s_visit(void*, u32 size, u32 tag, void* user)
+        {
+            visit_state_t* state = (visit_state_t*)user;
+            state->m_count += 1;
+            state->m_size += size;
+            state->m_tags += tag;
+            return state->m_count < state->m_limit;
+        }
+
+        static nsuperalloc::vmalloc_t* s_visit_heap = nullptr;
+
+        static bool s_visit_allocating(void* ptr, u32 size, u32 tag, void* user)
+        {
+            void* temp = s_visit_heap->allocate(64);
+            s_visit_heap->deallocate(temp);
+            return s_visit(ptr, size, tag, user);
+        }
+
+        UNITTEST_TEST(heap_visit)
+        {
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator);
+
+            void* ptrs[300];
+            for (u32 i = 0; i < 300; ++i)
+            {
+                ptrs[i] = valloc->allocate((i % 3) == 0 ? 64 : 3000);
+                valloc->set_tag(ptrs[i], i);
+            }
+            void* aligned = valloc->allocate(100000, 1024 * 1024);
+
+            // Free every 4th element, leaving holes in the chunks
+            u32 live = 301;
+            u64 size = valloc->get_size(aligned);
+            u64 tags = 0;
+            for (u32 i = 0; i < 300; ++i)
+            {
+                if ((i % 4) == 0)
+                {
+                    valloc->deallocate(ptrs[i]);
+                    ptrs[i] = nullptr;
+                    live -= 1;
+                }
+                else
+                {
+                    size += valloc->get_size(ptrs[i]);
+                    tags += i;
+                }
+            }
+
+            visit_state_t state = {0, 0xffffffff, 0, 0};
+            valloc->visit(s_visit, &state);
+            CHECK_EQUAL(live, state.m_count);
+            CHECK_EQUAL(size, state.m_size);
+            CHECK_EQUAL(tags, state.m_tags);
+
+            // The callback can stop the walk
+            visit_state_t limited = {0, 10, 0, 0};
+            valloc->visit(s_visit, &limited);
+            CHECK_EQUAL((u32)10, limited.m_count);
+
+            // The callback is called without the lock, it can use the allocator
+            visit_state_t using_heap = {0, 0xffffffff, 0, 0};
+            s_visit_heap             = valloc;
+            valloc->visit(s_visit_allocating, &using_heap);
+            s_visit_heap = nullptr;
+            CHECK_EQUAL(live, using_heap.m_count);
+
+            valloc->deallocate(aligned);
+            for (u32 i = 0; i < 300; ++i)
+                valloc->deallocate(ptrs[i]);
+            gDestroyVmAllocator(valloc);
+        }
+
+        UNITTEST_TEST(fragmentation_analyze)
+        {
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator);
+            valloc->record_sizes(true);
+
+            void* ptrs[256];
+            for (u32 i = 0; i < 256; ++i)
+                ptrs[i] = valloc->allocate(100);
+            for (u32 i = 0; i < 256; i += 2)
+                valloc->deallocate(ptrs[i]);
+
+            // A chunk that becomes empty is cached (kept committed)
+            void* block = valloc->allocate(40000);
+            valloc->deallocate(block);
+
+            nsuperalloc::fragmentation_t* report = g_allocate<nsuperalloc::fragmentation_t>(Allocator);
+            valloc->analyze(*report);
+
+            nsuperalloc::stats_t stats;
+            valloc->get_stats(stats);
+            CHECK_EQUAL((u64)stats.m_committed_pages * stats.m_page_size, report->m_committed_bytes);
+            CHECK_TRUE(report->m_num_sections >= 1);
+            CHECK_TRUE(report->m_cached_bytes > 0);
+
+            u32 const bin_size = valloc->get_size(ptrs[1]);
+            u64       used     = 0;
+            for (u32 b = 0; b < report->m_num_binconfigs; ++b)
+            {
+                nsuperalloc::bin_fragmentation_t const& bf = report->m_bins[b];
+                if (bf.m_elements_used == 0)
+                    continue;
+                CHECK_EQUAL(bin_size, bf.m_alloc_size);
+                CHECK_EQUAL((u64)128, bf.m_elements_used);
+                CHECK_EQUAL((u64)128, bf.m_elements_recorded);
+                CHECK_EQUAL((u64)128 * 100, bf.m_requested_bytes);
+                used += bf.m_elements_used * bf.m_alloc_size;
+            }
+            CHECK_EQUAL(used, report->m_used_bytes);
+            CHECK_EQUAL(used, report->m_recorded_bytes);
+            CHECK_EQUAL((u64)128 * 100, report->m_requested_bytes);
+            CHECK_TRUE(report->internal_fragmentation() >= 0.0 && report->internal_fragmentation() < 0.25);
+            CHECK_TRUE(report->external_fragmentation() > 0.0 && report->external_fragmentation() < 1.0);
+
+            u64 unused_address = 0;
+            for (u32 i = 0; i < report->m_num_sections && i < nsuperalloc::fragmentation_t::cMaxSections; ++i)
+                unused_address += report->m_sections[i].m_unused_address;
+            CHECK_EQUAL(report->m_unused_address, unused_address);
+
+            g_deallocate(Allocator, report);
+            for (u32 i = 1; i < 256; i += 2)
+                valloc->deallocate(ptrs[i]);
+            gDestroyVmAllocator(valloc);
+        }
+
+        static bool s_pressure(void* user, u64& target_bytes)
+        {
+            u32* polls = (u32*)user;
+            *polls += 1;
+            target_bytes = 0;
+            return true;
+        }
+
+        UNITTEST_TEST(trim_and_pressure)
+        {
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator);
+
+            void* small = valloc->allocate(64);
+            void* ptrs[64];
+            for (u32 i = 0; i < 64; ++i)
+                ptrs[i] = valloc->allocate(40000);
+            for (u32 i = 0; i < 64; ++i)
+                valloc->deallocate(ptrs[i]);
+
+            nsuperalloc::stats_t before;
+            valloc->get_stats(before);
+            u32 cached_pages = 0;
+            for (u32 c = 0; c < before.m_num_chunkconfigs; ++c)
+                cached_pages += before.m_chunkconfigs[c].m_cached_pages;
+            CHECK_TRUE(cached_pages > 0);
+
+            // Only the memory of the live element is still committed
+            u64 const trimmed = valloc->trim(0);
+            CHECK_TRUE(trimmed >= (u64)cached_pages * before.m_page_size);
+
+            nsuperalloc::stats_t after;
+            valloc->get_stats(after);
+            CHECK_EQUAL((u64)(before.m_committed_pages - after.m_committed_pages) * after.m_page_size, trimmed);
+            for (u32 c = 0; c < after.m_num_chunkconfigs; ++c)
+            {
+                CHECK_EQUAL((u32)0, after.m_chunkconfigs[c].m_cached_pages);
+                CHECK_EQUAL((u32)0, after.m_chunkconfigs[c].m_sections_cached);
+            }
+            CHECK_EQUAL((u64)0, valloc->trim(0));
+
+            // The trimmed chunks can be used again
+            for (u32 i = 0; i < 64; ++i)
+            {
+                ptrs[i] = valloc->allocate(40000);
+                CHECK_TRUE(ptrs[i] != nullptr);
+                ((u8*)ptrs[i])[0]     = 0xCD;
+                ((u8*)ptrs[i])[39999] = 0xCD;
+            }
+            for (u32 i = 0; i < 64; ++i)
+                valloc->deallocate(ptrs[i]);
+
+            // A pressure source that always reports pressure trims when a chunk is checked out
+            u32 polls = 0;
+            valloc->set_pressure_source(s_pressure, &polls, 0);
+            void* block = valloc->allocate(40000);
+            CHECK_TRUE(polls > 0);
+            nsuperalloc::stats_t pressured;
+            valloc->get_stats(pressured);
+            for (u32 c = 0; c < pressured.m_num_chunkconfigs; ++c)
+                CHECK_EQUAL((u32)0, pressured.m_chunkconfigs[c].m_cached_pages);
+            valloc->set_pressure_source(nullptr, nullptr, 0);
+
+            valloc->deallocate(block);
+            valloc->deallocate(small);
+            gDestroyVmAllocator(valloc);
+        }
+
+        UNITTEST_TEST(occupancy_buckets)
+        {
+            nsuperalloc::config_t const*    config     = nsuperalloc::gConfigWindowsDesktopApp25p();
+            u8 const                        bin_index  = config->size2bin(1024);
+            nsuperalloc::binconfig_t const& bin        = config->m_abinconfigs[bin_index];
+            u32 const                       count      = bin.m_max_alloc_count;
+            ptr_t const                     chunk_mask = ~(((ptr_t)1 << bin.m_chunk_config.m_sizeshift) - 1);
+            CHECK_TRUE(count >= 8);
+
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator);
+            void**                  ptrs   = g_allocate_array<void*>(Allocator, count * 2);
+
+            // Two full chunks, the first one is drained to a single element, the second one to half
+            for (u32 i = 0; i < count * 2; ++i)
+                ptrs[i] = valloc->allocate(1024);
+            ptr_t const chunk_a = (ptr_t)ptrs[0] & chunk_mask;
+            ptr_t const chunk_b = (ptr_t)ptrs[count] & chunk_mask;
+            CHECK_TRUE(chunk_a != chunk_b);
+            for (u32 i = 1; i < count; ++i)
+                valloc->deallocate(ptrs[i]);
+            for (u32 i = count; i < count + (count / 2); ++i)
+                valloc->deallocate(ptrs[i]);
+
+            // New elements come from the fullest chunk, the nearly empty one is left alone
+            for (u32 i = count; i < count + (count / 2); ++i)
+            {
+                ptrs[i] = valloc->allocate(1024);
+                CHECK_EQUAL(chunk_b, (ptr_t)ptrs[i] & chunk_mask);
+            }
+
+            // So that it can drain and be released
+            valloc->deallocate(ptrs[0]);
+            nsuperalloc::stats_t stats;
+            valloc->get_stats(stats);
+            CHECK_EQUAL((u32)0, stats.m_bins[bin_index].m_chunks_active);
+            CHECK_EQUAL((u32)1, stats.m_bins[bin_index].m_chunks_full);
+
+            for (u32 i = count; i < count * 2; ++i)
+                valloc->deallocate(ptrs[i]);
+            g_deallocate_array(Allocator, ptrs);
+            gDestroyVmAllocator(valloc);
+        }
+
+        UNITTEST_TEST(lazy_page_commit)
+        {
+            nsuperalloc::config_t const*    config    = nsuperalloc::gConfigWindowsDesktopApp25p();
+            u8 const                        bin_index = config->size2bin(40000);
+            nsuperalloc::binconfig_t const& bin       = config->m_abinconfigs[bin_index];
+            u32 const                       count     = bin.m_max_alloc_count;
+            CHECK_TRUE(count >= 4);
+
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator);
+            void**                  ptrs   = g_allocate_array<void*>(Allocator, count);
+
+            // A new chunk only commits the pages of its first element
+            nsuperalloc::stats_t stats;
+            ptrs[0] = valloc->allocate(40000);
+            valloc->get_stats(stats);
+            u32 const page_size  = stats.m_page_size;
+            u32 const full_pages = (u32)(((u64)bin.m_alloc_size * count + page_size - 1) / page_size);
+            CHECK_TRUE(stats.m_committed_pages >= (bin.m_alloc_size + page_size - 1) / page_size);
+            CHECK_TRUE(stats.m_committed_pages < full_pages);
+
+            // The rest is committed as the elements are taken
+            for (u32 i = 1; i < count; ++i)
+            {
+                ptrs[i]               = valloc->allocate(40000);
+                ((u8*)ptrs[i])[0]     = (u8)i;
+                ((u8*)ptrs[i])[39999] = (u8)i;
+            }
+            valloc->get_stats(stats);
+            CHECK_TRUE(stats.m_committed_pages >= full_pages);
+
+            // A cached chunk that is reused keeps its committed pages
+            for (u32 i = 0; i < count; ++i)
+                valloc->deallocate(ptrs[i]);
+            ptrs[0] = valloc->allocate(40000);
+            nsuperalloc::stats_t reused;
+            valloc->get_stats(reused);
+            CHECK_EQUAL(stats.m_committed_pages, reused.m_committed_pages);
+
+            valloc->deallocate(ptrs[0]);
+            g_deallocate_array(Allocator, ptrs);
+            gDestroyVmAllocator(valloc);
+        }
+
+        static ptr_t s_section_of(nsuperalloc::config_t const* config, void* ptr, u32 size)
+        {
+            nsuperalloc::binconfig_t const& bin = config->m_abinconfigs[config->size2bin(size)];
+            return (ptr_t)ptr >> bin.m_chunk_config.m_section_sizeshift;
+        }
+
+        UNITTEST_TEST(lifetime_hints)
+        {
+            nsuperalloc::config_t const* config = nsuperalloc::gConfigWindowsDesktopApp25p();
+            nsuperalloc::vmalloc_t*      valloc = gCreateVmAllocator(Allocator);
+
+            // Allocations of the same size but with a different lifetime never share a section
+            void* normal     = valloc->allocate(100, 8);
+            void* transient  = valloc->allocate(100, 8, nsuperalloc::cLifetimeTransient);
+            void* persistent = valloc->allocate(100, 8, nsuperalloc::cLifetimePersistent);
+            CHECK_TRUE(transient != nullptr);
+            CHECK_TRUE(persistent != nullptr);
+            CHECK_TRUE(s_section_of(config, normal, 100) != s_section_of(config, transient, 100));
+            CHECK_TRUE(s_section_of(config, normal, 100) != s_section_of(config, persistent, 100));
+            CHECK_TRUE(s_section_of(config, transient, 100) != s_section_of(config, persistent, 100));
+
+            // A reallocation that has to move keeps the lifetime
+            void* small = valloc->allocate(20, 8);
+            void* moved = valloc->reallocate(transient, 20, 8);
+            CHECK_TRUE(moved != transient);
+            CHECK_TRUE(s_section_of(config, moved, 20) != s_section_of(config, small, 20));
+
+            // Freeing the transient allocation releases its chunk, the chunk of the normal one stays
+            nsuperalloc::stats_t stats;
+            u8 const             small_bin = config->size2bin(20);
+            valloc->get_stats(stats);
+            CHECK_EQUAL(2, (s32)stats.m_bins[small_bin].m_chunks_active);
+            valloc->deallocate(moved);
+            valloc->get_stats(stats);
+            CHECK_EQUAL(1, (s32)stats.m_bins[small_bin].m_chunks_active);
+
+            valloc->deallocate(small);
+            valloc->deallocate(persistent);
+            valloc->deallocate(normal);
+            gDestroyVmAllocator(valloc);
+        }
+
+        static u32 s_chunks_used(nsuperalloc::vmalloc_t* valloc)
+        {
+            nsuperalloc::stats_t stats;
+            valloc->get_stats(stats);
+            u32 chunks = 0;
+            for (u32 c = 0; c < stats.m_num_chunkconfigs; ++c)
+                chunks += stats.m_chunkconfigs[c].m_chunks_used;
+            return chunks;
+        }
+
+        UNITTEST_TEST(child_heap)
+        {
+            nsuperalloc::vmalloc_t* parent        = gCreateVmAllocator(Allocator);
+            void*                   keep          = parent->allocate(100);
+            u32 const               chunks_before = s_chunks_used(parent);
+            ((u8*)keep)[0]                        = 0xAB;
+
+            // The child takes its chunks from the address space of the parent, it fills some chunks
+            // completely, leaves others partly used and has a chunk of its own for an aligned allocation
+            nsuperalloc::vmalloc_t* child = gCreateChildHeap(parent);
+            for (u32 i = 0; i < 2000; ++i)
+            {
+                void* ptr = child->allocate(16 + (i % 8) * 16, 8, (i & 1) ? nsuperalloc::cLifetimeTransient : nsuperalloc::cLifetimeNormal);
+                CHECK_TRUE(ptr != nullptr);
+            }
+            void* aligned = child->allocate(100, 64 * cKB);
+            CHECK_EQUAL((ptr_t)0, (ptr_t)aligned & (ptr_t)(64 * cKB - 1));
+            void* freed = child->allocate(5000);
+            child->deallocate(freed);
+            CHECK_TRUE(s_chunks_used(parent) > chunks_before);
+
+            // Destroying the child hands back all of its chunks without freeing the allocations
+            gDestroyChildHeap(child);
+            CHECK_EQUAL(chunks_before, s_chunks_used(parent));
+            CHECK_EQUAL(0xAB, (s32)((u8*)keep)[0]);
+
+            parent->deallocate(keep);
+            gDestroyVmAllocator(parent);
+        }
+
+        UNITTEST_TEST(supermemory_regions)
+        {
+            // A heap on system pages, one on huge pages and a read-mostly one
+            nsuperalloc::region_t regions[3];
+            for (u32 i = 0; i < 3; ++i)
+            {
+                regions[i].m_config   = nullptr;
+                regions[i].m_pages    = nsuperalloc::region_t::cPagesDefault;
+                regions[i].m_protect  = nsuperalloc::region_t::cProtectReadWrite;
+                regions[i].m_padding  = 0;
+                regions[i].m_padding2 = 0;
+            }
+            regions[0].m_pages = nsuperalloc::region_t::cPagesSmall;
+            regions[1].m_pages = nsuperalloc::region_t::cPagesHuge;
+
+            supermemory_t*          memory = gCreateSuperMemory(Allocator, regions, 3);
+            nsuperalloc::vmalloc_t* heaps[3];
+            void*                   ptrs[3];
+            for (u32 i = 0; i < 3; ++i)
+            {
+                heaps[i] = gCreateVmAllocator(memory, i);
+                ptrs[i]  = heaps[i]->allocate(100);
+                CHECK_TRUE(ptrs[i] != nullptr);
+                CHECK_EQUAL(i, gRegionOf(memory, ptrs[i]));
+                ((u8*)ptrs[i])[0] = (u8)i;
+            }
+
+            // Two heaps on the same region share its address space
+            nsuperalloc::vmalloc_t* shared = gCreateVmAllocator(memory, 2);
+            void*                   ptr    = shared->allocate(5000);
+            CHECK_EQUAL((u32)2, gRegionOf(memory, ptr));
+            u32 local = 0;
+            CHECK_EQUAL((u32)3, gRegionOf(memory, &local));
+
+            // The read-mostly region is sealed after it has been written
+            gProtectRegion(memory, 2, nsuperalloc::region_t::cProtectReadOnly);
+            CHECK_EQUAL(2, (s32)((u8*)ptrs[2])[0]);
+            gProtectRegion(memory, 2, nsuperalloc::region_t::cProtectReadWrite);
+            ((u8*)ptrs[2])[0] = 0xCD;
+            CHECK_EQUAL(0, (s32)((u8*)ptrs[0])[0]);
+            CHECK_EQUAL(1, (s32)((u8*)ptrs[1])[0]);
+            CHECK_EQUAL(0xCD, (s32)((u8*)ptrs[2])[0]);
+
+            shared->deallocate(ptr);
+            gDestroyVmAllocator(shared);
+            for (u32 i = 0; i < 3; ++i)
+            {
+                heaps[i]->deallocate(ptrs[i]);
+                gDestroyVmAllocator(heaps[i]);
+            }
+            gDestroySuperMemory(memory);
+        }
+
+        UNITTEST_TEST(offset_backend)
+        {
+            // The allocator never touches the memory, so the addresses can be offsets into memory that lives elsewhere
+            u64 const               base    = (u64)1 << 40;
+            nsuperalloc::backend_t* backend = nsuperalloc::gCreateOffsetBackend(Allocator, base, 12);
+            nsuperalloc::vmalloc_t* valloc  = gCreateVmAllocator(Allocator, nsuperalloc::gConfigWindowsDesktopApp25p(), backend);
+
+            void* small = valloc->allocate(100);
+            void* large = valloc->allocate(300 * cKB);
+            CHECK_TRUE((u64)small >= base);
+            CHECK_TRUE((u64)large >= base);
+            CHECK_TRUE(valloc->get_size(large) >= (u32)(300 * cKB));
+
+            nsuperalloc::backend_stats_t stats;
+            backend->get_stats(stats);
+            CHECK_TRUE(stats.m_reserved_bytes > 0);
+            CHECK_TRUE(stats.m_committed_bytes >= 300 * cKB);
+            CHECK_TRUE(stats.m_commit_calls >= 2);
+
+            // A reallocation can not copy, it succeeds in place and otherwise leaves the allocation as it is
+            u32 const small_size = valloc->get_size(small);
+            CHECK_TRUE(small == valloc->reallocate(small, small_size, 8));
+            CHECK_TRUE(nullptr == valloc->reallocate(small, 5000, 8));
+            CHECK_EQUAL(small_size, valloc->get_size(small));
+
+            valloc->deallocate(small);
+            valloc->deallocate(large);
+            valloc->trim(0);
+            backend->get_stats(stats);
+            CHECK_EQUAL((u64)0, stats.m_committed_bytes);
+
+            gDestroyVmAllocator(valloc);
+            backend->get_stats(stats);
+            CHECK_EQUAL((u64)0, stats.m_reserved_bytes);
+            nsuperalloc::gDestroyBackend(Allocator, backend);
+        }
+
+        UNITTEST_TEST(device_mock_backend)
+        {
+            nsuperalloc::backend_t* backend = nsuperalloc::gCreateDeviceMockBackend(Allocator);
+            nsuperalloc::vmalloc_t* valloc  = gCreateVmAllocator(Allocator, nsuperalloc::gConfigWindowsDesktopApp25p(), backend);
+
+            // Fresh memory is not cleared, like device memory
+            u8* ptr = (u8*)valloc->allocate(1000);
+            CHECK_EQUAL(0xDD, (s32)ptr[0]);
+            CHECK_EQUAL(0xDD, (s32)ptr[999]);
+            ptr[0] = 1;
+
+            nsuperalloc::backend_stats_t stats;
+            backend->get_stats(stats);
+            CHECK_TRUE(stats.m_committed_bytes > 0);
+            CHECK_EQUAL(stats.m_committed_bytes, stats.m_peak_committed_bytes);
+
+            valloc->deallocate(ptr);
+            valloc->trim(0);
+            backend->get_stats(stats);
+            CHECK_EQUAL((u64)0, stats.m_committed_bytes);
+            CHECK_TRUE(stats.m_decommit_calls > 0);
+
+            gDestroyVmAllocator(valloc);
+            nsuperalloc::gDestroyBackend(Allocator, backend);
+        }
+
+        UNITTEST_TEST(device_mock_backend_cached_run)
+        {
+            nsuperalloc::backend_t* backend = nsuperalloc::gCreateDeviceMockBackend(Allocator);
+            nsuperalloc::vmalloc_t* valloc  = gCreateVmAllocator(Allocator, nsuperalloc::gConfigWindowsDesktopApp25p(), backend);
+
+            // Two adjacent 128 KiB chunks of an aligned bin, of which only the pages of the element are committed
+            void* a = valloc->allocate(100000, 128 * cKB);
+            void* b = valloc->allocate(100000, 128 * cKB);
+            CHECK_TRUE(a != nullptr && b != nullptr);
+
+            nsuperalloc::backend_stats_t stats;
+            backend->get_stats(stats);
+            u64 const committed = stats.m_committed_bytes;
+            CHECK_TRUE(committed < (u64)2 * 128 * cKB);
+
+            // Both are cached when freed, trimming decommits only their committed pages
+            valloc->deallocate(a);
+            valloc->deallocate(b);
+            backend->get_stats(stats);
+            CHECK_EQUAL(committed, stats.m_committed_bytes);
+            valloc->trim(0);
+            backend->get_stats(stats);
+            CHECK_EQUAL((u64)0, stats.m_committed_bytes);
+            CHECK_TRUE(stats.m_decommit_calls >= 2);
+
+            gDestroyVmAllocator(valloc);
+            nsuperalloc::gDestroyBackend(Allocator, backend);
+        }
+
+        static u32 s_fake_node(void* user) { return *(u32 const*)user; }
+
+        UNITTEST_TEST(numa_fake_topology)
+        {
+            nsuperalloc::config_t const* config = nsuperalloc::gConfigWindowsDesktopApp25p();
+
+            u32                 node = 0;
+            nsuperalloc::numa_t numa;
+            numa.m_num_nodes = 2;
+            numa.m_padding   = 0;
+            numa.m_node_fn   = s_fake_node;
+            numa.m_node_user = &node;
+
+            nsuperalloc::vmalloc_t* valloc = gCreateVmAllocator(Allocator, config, numa);
+
+            // Allocations of an aligned bin get a chunk of their own, so every one of them is checked out on 'node'
+            void* ptrs[2][8];
+            for (node = 0; node < 2; ++node)
+            {
+                for (u32 i = 0; i < 8; ++i)
+                {
+                    ptrs[node][i] = valloc->allocate(100000, 1024 * 1024);
+                    CHECK_TRUE(ptrs[node][i] != nullptr);
+                    ((u8*)ptrs[node][i])[0] = (u8)node;
+                }
+            }
+
+            // The sections of the two nodes live in different halves of the address space
+            nsuperalloc::fragmentation_t* report = g_allocate<nsuperalloc::fragmentation_t>(Allocator);
+            valloc->analyze(*report);
+            u64 const node_range  = config->m_total_address_size / 2;
+            u32       sections[2] = {0, 0};
+            for (u32 i = 0; i < report->m_num_sections && i < nsuperalloc::fragmentation_t::cMaxSections; ++i)
+            {
+                if (report->m_sections[i].m_chunks_used > 0)
+                    sections[report->m_sections[i].m_address_offset >= node_range ? 1 : 0] += 1;
+            }
+            CHECK_TRUE(sections[0] > 0);
+            CHECK_TRUE(sections[1] > 0);
+            g_deallocate(Allocator, report);
+
+            // Looking up the chunk of an address does not depend on the node
+            for (u32 n = 0; n < 2; ++n)
+            {
+                for (u32 i = 0; i < 8; ++i)
+                {
+                    CHECK_TRUE(valloc->get_size(ptrs[n][i]) >= 100000);
+                    CHECK_EQUAL((u8)n, ((u8*)ptrs[n][i])[0]);
+                    valloc->deallocate(ptrs[n][i]);
+                }
+            }
+            gDestroyVmAllocator(valloc);
+        }
+
+        UNITTEST_TEST(trace_record_replay)
+        {
+            nsuperalloc::vmalloc_t* valloc   = gCreateVmAllocator(Allocator);
+            void*                   untraced = valloc->allocate(64);
+
+            nsuperalloc::trace_t*   trace   = nsuperalloc::gCreateTrace(Allocator, nullptr);
+            nsuperalloc::vmalloc_t* thread0 = nsuperalloc::gCreateRecordingAllocator(trace, valloc, 0);
+            nsuperalloc::vmalloc_t* thread1 = nsuperalloc::gCreateRecordingAllocator(trace, valloc, 1);
+
+            void* a = thread0->allocate(100);
+            void* b = thread0->allocate(2000);
+            thread1->deallocate(a);
+            void* c = thread1->reallocate(b, 5000);
+            thread0->deallocate(untraced);  // allocated before the trace started, not recorded
+            thread0->deallocate(c);
+
+            u32        num_records = 0;
+            s32 const* records     = nsuperalloc::gTraceRecords(trace, num_records);
+
+            // thread 0, alloc, alloc, thread 1, free, free + alloc (realloc), thread 0, free
+            CHECK_EQUAL((u32)9, num_records);
+            CHECK_EQUAL((s32)nsuperalloc::cTraceThread, records[0]);
+            CHECK_EQUAL(0, records[1]);
+            CHECK_EQUAL(100, records[2]);
+            CHECK_EQUAL(2000, records[4]);
+            CHECK_EQUAL((s32)nsuperalloc::cTraceThread, records[6]);
+            CHECK_EQUAL(1, records[7]);
+            CHECK_EQUAL(-100, records[8]);
+            CHECK_EQUAL(1, records[9]);
+            CHECK_EQUAL(-2000, records[10]);
+            CHECK_EQUAL(2, records[11]);
+            CHECK_EQUAL(5000, records[12]);
+            CHECK_EQUAL((s32)nsuperalloc::cTraceThread, records[14]);
+            CHECK_EQUAL(0, records[15]);
+            CHECK_EQUAL(-5000, records[16]);
+            CHECK_EQUAL(6, records[17]);
+
+            // Replay the trace on a fresh allocator, which serves both threads
+            nsuperalloc::vmalloc_t*     replay       = gCreateVmAllocator(Allocator);
+            nsuperalloc::vmalloc_t*     allocators[] = {replay};
+            nsuperalloc::replay_stats_t stats;
+            CHECK_TRUE(nsuperalloc::gReplayTrace(Allocator, allocators, 1, records, num_records, stats));
+            CHECK_EQUAL((u64)3, stats.m_ops[nsuperalloc::replay_stats_t::cAlloc]);
+            CHECK_EQUAL((u64)3, stats.m_ops[nsuperalloc::replay_stats_t::cFree]);
+            CHECK_EQUAL((u32)0, stats.m_failed_allocs);
+            CHECK_EQUAL((u64)0, stats.m_final_live_bytes);
+            CHECK_TRUE(stats.m_p50_ns[nsuperalloc::replay_stats_t::cAlloc] <= stats.m_p999_ns[nsuperalloc::replay_stats_t::cAlloc]);
+            CHECK_TRUE(stats.m_peak_committed_pages > 0);
+
+            // A free that refers to a record that is not before it is malformed
+            s32 const malformed[] = {100, 0, -100, 1};
+            CHECK_TRUE(!nsuperalloc::gReplayTrace(Allocator, allocators, 1, malformed, 2, stats));
+
+            gDestroyVmAllocator(replay);
+            nsuperalloc::gDestroyRecordingAllocator(thread1);
+            nsuperalloc::gDestroyRecordingAllocator(thread0);
+            nsuperalloc::gDestroyTrace(trace);
+            gDestroyVmAllocator(valloc);
+        }
+
+        UNITTEST_TEST(trace_failed_reallocate)
+        {
+            // The offset backend cannot move an allocation, so growing beyond the bin fails
+            nsuperalloc::backend_t* backend  = nsuperalloc::gCreateOffsetBackend(Allocator, (u64)1 << 40, 12);
+            nsuperalloc::vmalloc_t* valloc   = gCreateVmAllocator(Allocator, nsuperalloc::gConfigWindowsDesktopApp25p(), backend);
+            nsuperalloc::trace_t*   trace    = nsuperalloc::gCreateTrace(Allocator, nullptr);
+            nsuperalloc::vmalloc_t* recorder = nsuperalloc::gCreateRecordingAllocator(trace, valloc, 0);
+
+            void* ptr = recorder->allocate(100);
+            CHECK_TRUE(nullptr == recorder->reallocate(ptr, 5000, 8));
+            recorder->deallocate(ptr);
+
+            // thread 0, alloc, free of the allocation that is still live after the failed reallocation
+            u32        num_records = 0;
+            s32 const* records     = nsuperalloc::gTraceRecords(trace, num_records);
+            CHECK_EQUAL((u32)3, num_records);
+            CHECK_EQUAL(100, records[2]);
+            CHECK_EQUAL(-100, records[4]);
+            CHECK_EQUAL(1, records[5]);
+
+            nsuperalloc::gDestroyRecordingAllocator(recorder);
+            nsuperalloc::gDestroyTrace(trace);
+            gDestroyVmAllocator(valloc);
+            nsuperalloc::gDestroyBackend(Allocator, backend);
+        }
+
         UNITTEST_TEST(stress_test)
         {
             alloc_with_stats_t s_alloc;